@@ -14,9 +14,6 @@
  */
 
 #include "AsyncCallback.h"
-#include <memory>
-
-extern size_t g_contextLen;
 
 napi_value AsyncCallback::AsyncCallbackRead(napi_env env, napi_callback_info info) {
     size_t argc = 3;
@@ -44,21 +41,8 @@ napi_value AsyncCallback::AsyncCallbackRead(napi_env env, napi_callback_info inf
 void AsyncCallback::ExecuteCB(napi_env env, void *data) {
     CallbackData *asyncContext = reinterpret_cast<CallbackData *>(data);
 
-    RawFile *rawFile = OH_ResourceManager_OpenRawFile(asyncContext->resMgr, asyncContext->fileNameBuf);
-    
-    std::unique_ptr<char[]> fileData = std::make_unique<char[]>(g_contextLen);
-
-    long offset = 0;
-    while (OH_ResourceManager_GetRawFileRemainingLength(rawFile) > 0) {
-        OH_ResourceManager_ReadRawFile(rawFile, fileData.get() + offset, 100);
-        offset += 100;
-    }
-    
-    OH_ResourceManager_CloseRawFile(rawFile);
+    asyncContext->reader.openRawFile(asyncContext->resMgr, asyncContext->fileNameBuf);
     OH_ResourceManager_ReleaseNativeResourceManager(asyncContext->resMgr);
-
-    char *temp = fileData.get();
-    asyncContext->result = temp;
 };
 void AsyncCallback::CompleteCB(napi_env env, napi_status status, void *data) {
     CallbackData *asyncContext = static_cast<CallbackData *>(data);
@@ -67,7 +51,7 @@ void AsyncCallback::CompleteCB(napi_env env, napi_status status, void *data) {
     napi_get_reference_value(env, asyncContext->callbackRef, &callback);
 
     napi_value contents;
-    napi_create_string_utf8(env, asyncContext->result.c_str(), NAPI_AUTO_LENGTH, &contents);
+    napi_create_string_utf8(env, asyncContext->reader.data(), asyncContext->reader.size(), &contents);
 
     napi_value res;
     napi_call_function(env, nullptr, callback, 1, &contents, &res);
@@ -17,7 +17,7 @@
 #define NATIVECASE_ASYNCCALLBACK_H
 #include "napi/native_api.h"
 #include "rawfile/raw_file_manager.h"
-#include <string>
+#include "RawResource/RawResourceReader.h"
 class AsyncCallback {
 public:
     struct CallbackData {
@@ -25,7 +25,7 @@ public:
         napi_ref callbackRef = nullptr;
         char fileNameBuf[256] = {};
         NativeResourceManager *resMgr = nullptr;
-        std::string result = "";
+        RawResourceReader reader;
     };
 
     static napi_value AsyncCallbackRead(napi_env env, napi_callback_info info);
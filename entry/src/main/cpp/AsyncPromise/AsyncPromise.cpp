@@ -14,8 +14,6 @@
  */
 
 #include "AsyncPromise.h"
-#include <memory>
-extern size_t g_contextLen;
 
 napi_value AsyncPromise::AsyncPromiseRead(napi_env env, napi_callback_info info) {
     size_t argc = 2;
@@ -45,28 +43,15 @@ napi_value AsyncPromise::AsyncPromiseRead(napi_env env, napi_callback_info info)
 void AsyncPromise::ExecuteCB(napi_env env, void *data) {
     PromiseData *asyncContext = reinterpret_cast<PromiseData *>(data);
 
-    RawFile *rawFile = OH_ResourceManager_OpenRawFile(asyncContext->resMgr, asyncContext->fileNameBuf);
-
-    std::unique_ptr<char[]> fileData = std::make_unique<char[]>(g_contextLen);
-
-    long offset = 0;
-    while (OH_ResourceManager_GetRawFileRemainingLength(rawFile) > 0) {
-        OH_ResourceManager_ReadRawFile(rawFile, fileData.get() + offset, 100);
-        offset += 100;
-    }
-    OH_ResourceManager_CloseRawFile(rawFile);
+    asyncContext->reader.openRawFile(asyncContext->resMgr, asyncContext->fileNameBuf);
     OH_ResourceManager_ReleaseNativeResourceManager(asyncContext->resMgr);
-
-    char *temp = fileData.get();
-    asyncContext->result = temp;
-    
 };
 void AsyncPromise::CompleteCB(napi_env env, napi_status status, void *data) {
     PromiseData *asyncContext = reinterpret_cast<PromiseData *>(data);
 
     napi_value contents;
 //     napi_create_string_utf8(env, asyncContext->result, NAPI_AUTO_LENGTH, &contents);
-    napi_create_string_utf8(env, asyncContext->result.c_str(), NAPI_AUTO_LENGTH, &contents);
+    napi_create_string_utf8(env, asyncContext->reader.data(), asyncContext->reader.size(), &contents);
 
     if (contents != nullptr) {
         napi_resolve_deferred(env, asyncContext->deferred, contents);
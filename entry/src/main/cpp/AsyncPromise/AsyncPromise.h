@@ -17,7 +17,7 @@
 #define NATIVECASE_ASYNCPROMISE_H
 #include "napi/native_api.h"
 #include "rawfile/raw_file_manager.h"
-#include <string>
+#include "RawResource/RawResourceReader.h"
 
 class AsyncPromise {
 public:
@@ -26,7 +26,7 @@ public:
         napi_deferred deferred = nullptr;
         char fileNameBuf[256] = {};
         NativeResourceManager *resMgr = nullptr;
-        std::string result = "";
+        RawResourceReader reader;
     };
 
     static napi_value AsyncPromiseRead(napi_env env, napi_callback_info info);
@@ -0,0 +1,303 @@
+// Host benchmark for LlamaCppInterface: measures prefill and decode throughput, time to first
+// token and peak RSS over a grid of prompt lengths and thread counts, and prints JSON results.
+//
+//   llama-ohos-bench -m model.gguf [-p 128,512] [-n 128] [-t 1,2,4] [-c 0] [-b 512] [-ub 512]
+//                    [-r 3] [--label name] [-o results.json]
+//                    [--memory-pressure moderate|low|critical] [--spill-dir dir]
+//
+// --memory-pressure simulates the system memory level callback before every measured run, so the
+// results include restoring the released state.
+
+#include "LlamaCppInterface/LlamaCppInterface.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::string modelPath;
+    std::vector<int> promptLengths = {128, 512};
+    std::vector<int> threadCounts = {1, 2, 4};
+    int genTokens = 128;
+    int contextSize = 0;  // 0: sized to the longest prompt plus genTokens
+    int batchSize = 512;
+    int ubatchSize = 512;
+    int repetitions = 3;
+    std::string label;
+    std::string outputPath;
+    std::string memoryPressure = "none";
+    std::string spillDirectory;
+};
+
+struct BenchResult {
+    int threads = 0;
+    int rep = 0;
+    int promptLength = 0;     // requested
+    size_t promptTokens = 0;  // actually prefilled
+    int genTokens = 0;
+    double loadMs = 0;
+    double prefillMs = 0;
+    double ttftMs = 0;
+    double decodeMs = 0;
+    long peakRssKb = 0;
+};
+
+double elapsedMs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::vector<int> parseList(const std::string& value) {
+    std::vector<int> list;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            list.push_back(std::atoi(item.c_str()));
+        }
+    }
+    return list;
+}
+
+// Common words that are a single token in most vocabularies, so the prompt length in tokens
+// tracks the word count. Starting at a different word on every run defeats KV prefix reuse.
+std::string makePrompt(int words, size_t offset) {
+    static const char* kWords[] = {"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+                                   "and", "then", "runs", "into", "green", "field", "with", "light"};
+    const size_t nWords = sizeof(kWords) / sizeof(kWords[0]);
+    std::string prompt;
+    for (int i = 0; i < words; ++i) {
+        if (i > 0) {
+            prompt += ' ';
+        }
+        prompt += kWords[(offset + i) % nWords];
+    }
+    return prompt;
+}
+
+// Resets the kernel's peak RSS counter so each run reports its own high-water mark; older
+// kernels ignore the write and the value stays cumulative for the process
+void resetPeakRss() {
+    if (FILE* file = std::fopen("/proc/self/clear_refs", "w")) {
+        std::fputs("5", file);
+        std::fclose(file);
+    }
+}
+
+long peakRssKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::atol(line.c_str() + 6);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+std::string jsonString(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+double perSecond(double count, double ms) {
+    return ms > 0 ? count * 1000.0 / ms : 0.0;
+}
+
+BenchResult runOnce(LlamaCppInterface& llama, int promptLength, int genTokens, size_t offset) {
+    BenchResult result;
+    result.promptLength = promptLength;
+    const std::string prompt = makePrompt(promptLength, offset);
+
+    resetPeakRss();
+    llama.generateText(prompt, genTokens, 0.8f, 0.95f);
+
+    // The interface's own timings, so the bench measures exactly what getPerfStats() reports on device
+    const LlamaCppInterface::RequestPerf perf = llama.getPerfStats().last;
+    result.promptTokens = perf.prefilledTokens;
+    result.genTokens = static_cast<int>(perf.generatedTokens);
+    result.prefillMs = perf.prefillMs;
+    result.ttftMs = perf.ttftMs;
+    result.decodeMs = perf.decodeMs;
+    result.peakRssKb = peakRssKb();
+    return result;
+}
+
+void writeJson(std::ostream& out, const BenchOptions& options, const std::vector<BenchResult>& results) {
+    out << "{\n";
+    out << "  \"model\": " << jsonString(options.modelPath) << ",\n";
+    out << "  \"label\": " << jsonString(options.label) << ",\n";
+    out << "  \"timestamp\": " << static_cast<long long>(std::time(nullptr)) << ",\n";
+    out << "  \"config\": {\"context_size\": " << options.contextSize << ", \"batch_size\": " << options.batchSize
+        << ", \"ubatch_size\": " << options.ubatchSize << ", \"gen_tokens\": " << options.genTokens
+        << ", \"repetitions\": " << options.repetitions
+        << ", \"memory_pressure\": " << jsonString(options.memoryPressure) << "},\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << (i > 0 ? ",\n" : "\n");
+        out << "    {\"threads\": " << r.threads << ", \"rep\": " << r.rep
+            << ", \"prompt_length\": " << r.promptLength << ", \"prompt_tokens\": " << r.promptTokens
+            << ", \"gen_tokens\": " << r.genTokens << ", \"load_ms\": " << r.loadMs
+            << ", \"prefill_ms\": " << r.prefillMs << ", \"prefill_tps\": " << perSecond(r.promptTokens, r.prefillMs)
+            << ", \"ttft_ms\": " << r.ttftMs << ", \"decode_ms\": " << r.decodeMs
+            << ", \"decode_tps\": " << perSecond(r.genTokens, r.decodeMs) << ", \"peak_rss_kb\": " << r.peakRssKb << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+bool parseMemoryPressure(const std::string& name, LlamaCppInterface::MemoryPressure* level) {
+    static const char* kNames[] = {"none", "moderate", "low", "critical"};
+    for (int i = 0; i < 4; ++i) {
+        if (name == kNames[i]) {
+            if (level) {
+                *level = static_cast<LlamaCppInterface::MemoryPressure>(i);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseArgs(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (arg == "-m" || arg == "--model") {
+            options.modelPath = value;
+        } else if (arg == "-p" || arg == "--prompt-lengths") {
+            options.promptLengths = parseList(value);
+        } else if (arg == "-n" || arg == "--gen-tokens") {
+            options.genTokens = std::atoi(value.c_str());
+        } else if (arg == "-t" || arg == "--threads") {
+            options.threadCounts = parseList(value);
+        } else if (arg == "-c" || arg == "--context-size") {
+            options.contextSize = std::atoi(value.c_str());
+        } else if (arg == "-b" || arg == "--batch-size") {
+            options.batchSize = std::atoi(value.c_str());
+        } else if (arg == "-ub" || arg == "--ubatch-size") {
+            options.ubatchSize = std::atoi(value.c_str());
+        } else if (arg == "-r" || arg == "--repetitions") {
+            options.repetitions = std::atoi(value.c_str());
+        } else if (arg == "--label") {
+            options.label = value;
+        } else if (arg == "-o" || arg == "--output") {
+            options.outputPath = value;
+        } else if (arg == "--memory-pressure") {
+            options.memoryPressure = value;
+        } else if (arg == "--spill-dir") {
+            options.spillDirectory = value;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (options.modelPath.empty() || options.promptLengths.empty() || options.threadCounts.empty() ||
+        !parseMemoryPressure(options.memoryPressure, nullptr)) {
+        std::cerr << "Usage: llama-ohos-bench -m model.gguf [-p 128,512] [-n 128] [-t 1,2,4] [-c 0] "
+                     "[-b 512] [-ub 512] [-r 3] [--label name] [-o results.json] "
+                     "[--memory-pressure moderate|low|critical] [--spill-dir dir]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        return 1;
+    }
+    if (options.contextSize <= 0) {
+        int longest = 0;
+        for (int length : options.promptLengths) {
+            longest = std::max(longest, length);
+        }
+        options.contextSize = longest + options.genTokens + 64;
+    }
+
+    std::vector<BenchResult> results;
+    size_t runIndex = 0;
+    for (int threads : options.threadCounts) {
+        LlamaCppInterface llama;
+        LlamaCppInterface::LoadConfig config;
+        config.contextSize = options.contextSize;
+        config.threads = threads;
+        config.batchSize = options.batchSize;
+        config.ubatchSize = options.ubatchSize;
+        config.spillDirectory = options.spillDirectory;
+        LlamaCppInterface::MemoryPressure pressure = LlamaCppInterface::MemoryPressure::None;
+        parseMemoryPressure(options.memoryPressure, &pressure);
+
+        Clock::time_point loadStart = Clock::now();
+        if (!llama.loadModel(options.modelPath, config)) {
+            std::cerr << "Failed to load model: " << llama.getLastError() << std::endl;
+            return 1;
+        }
+        const double loadMs = elapsedMs(loadStart, Clock::now());
+
+        // Warm up caches and lazily allocated buffers before measuring
+        runOnce(llama, 16, 4, runIndex++);
+
+        for (int promptLength : options.promptLengths) {
+            for (int rep = 0; rep < options.repetitions; ++rep) {
+                llama.handleMemoryPressure(pressure);
+                BenchResult result = runOnce(llama, promptLength, options.genTokens, runIndex++);
+                result.threads = threads;
+                result.rep = rep;
+                result.loadMs = loadMs;
+                results.push_back(result);
+                std::cerr << "threads=" << threads << " prompt=" << result.promptTokens
+                          << " ttft=" << result.ttftMs << "ms gen=" << result.genTokens << std::endl;
+            }
+        }
+        llama.unloadModel();
+    }
+
+    if (options.outputPath.empty()) {
+        writeJson(std::cout, options, results);
+    } else {
+        std::ofstream out(options.outputPath);
+        if (!out) {
+            std::cerr << "Cannot write " << options.outputPath << std::endl;
+            return 1;
+        }
+        writeJson(out, options, results);
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+// Host benchmark for RawResourceReader: opens a file with each read strategy, touches every byte and
+// prints JSON with the open and scan time and the resulting throughput. "small" is the old loop of
+// 100-byte reads into a buffer, for comparison.
+//
+//   raw-resource-bench -f file [-r 5] [-o results.json]
+//
+// Repetitions after the first are served from the page cache; drop it between runs to measure the disk.
+
+#include "RawResource/RawResourceReader.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ReadResult {
+    std::string mode;
+    int rep = 0;
+    size_t bytes = 0;
+    double openMs = 0;
+    double scanMs = 0;
+    uint64_t checksum = 0;
+};
+
+double elapsedMs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Sums every 64th byte so mapped pages are faulted in and the work cannot be optimized away
+uint64_t scan(const char* data, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i += 64) {
+        sum += static_cast<unsigned char>(data[i]);
+    }
+    return sum;
+}
+
+bool readSmall(const std::string& path, std::unique_ptr<char[]>& buffer, size_t& size) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    size = static_cast<size_t>(st.st_size);
+    buffer.reset(new char[size + 100]);
+    size_t offset = 0;
+    ssize_t n = 0;
+    while ((n = read(fd, buffer.get() + offset, 100)) > 0) {
+        offset += static_cast<size_t>(n);
+    }
+    close(fd);
+    return n == 0;
+}
+
+ReadResult runOnce(const std::string& path, const std::string& mode) {
+    ReadResult result;
+    result.mode = mode;
+    RawResourceReader reader;
+    std::unique_ptr<char[]> buffer;
+    const char* data = nullptr;
+
+    const Clock::time_point start = Clock::now();
+    bool opened = false;
+    if (mode == "small") {
+        opened = readSmall(path, buffer, result.bytes);
+        data = buffer.get();
+    } else {
+        opened = reader.openFile(path, mode == "mmap");
+        data = reader.data();
+        result.bytes = reader.size();
+    }
+    const Clock::time_point openEnd = Clock::now();
+    if (!opened) {
+        result.bytes = 0;
+        return result;
+    }
+    result.checksum = scan(data, result.bytes);
+    result.openMs = elapsedMs(start, openEnd);
+    result.scanMs = elapsedMs(openEnd, Clock::now());
+    return result;
+}
+
+void writeJson(std::ostream& out, const std::string& path, const std::vector<ReadResult>& results) {
+    out << "{\n  \"file\": \"" << path << "\",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const ReadResult& r = results[i];
+        const double totalMs = r.openMs + r.scanMs;
+        out << (i > 0 ? ",\n" : "\n");
+        out << "    {\"mode\": \"" << r.mode << "\", \"rep\": " << r.rep << ", \"bytes\": " << r.bytes
+            << ", \"open_ms\": " << r.openMs << ", \"scan_ms\": " << r.scanMs
+            << ", \"mb_per_s\": " << (totalMs > 0 ? r.bytes / 1048576.0 * 1000.0 / totalMs : 0.0)
+            << ", \"checksum\": " << r.checksum << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string path;
+    std::string outputPath;
+    int repetitions = 5;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string arg = argv[i];
+        if (arg == "-f" || arg == "--file") {
+            path = argv[i + 1];
+        } else if (arg == "-r" || arg == "--repetitions") {
+            repetitions = std::atoi(argv[i + 1]);
+        } else if (arg == "-o" || arg == "--output") {
+            outputPath = argv[i + 1];
+        }
+    }
+    if (path.empty()) {
+        std::cerr << "Usage: raw-resource-bench -f file [-r 5] [-o results.json]" << std::endl;
+        return 1;
+    }
+
+    std::vector<ReadResult> results;
+    for (const char* mode : {"mmap", "chunked", "small"}) {
+        for (int rep = 0; rep < repetitions; ++rep) {
+            ReadResult result = runOnce(path, mode);
+            if (result.bytes == 0) {
+                std::cerr << "Cannot read " << path << std::endl;
+                return 1;
+            }
+            result.rep = rep;
+            results.push_back(result);
+        }
+    }
+
+    if (outputPath.empty()) {
+        writeJson(std::cout, path, results);
+    } else {
+        std::ofstream out(outputPath);
+        if (!out) {
+            std::cerr << "Cannot write " << outputPath << std::endl;
+            return 1;
+        }
+        writeJson(out, path, results);
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "CpuTopology.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// Reads the first number in a sysfs file, 0 if it is missing
+long readNumber(const std::string& path) {
+    std::ifstream file(path);
+    long value = 0;
+    return file >> value ? value : 0;
+}
+
+} // namespace
+
+CpuTopology CpuTopology::detect(const std::string& sysfsRoot) {
+    CpuTopology topology;
+    std::ifstream online(sysfsRoot + "/online");
+    std::string list;
+    if (std::getline(online, list)) {
+        topology.cpus_ = parseCpuList(list);
+    }
+    if (topology.cpus_.empty()) {
+        for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+            topology.cpus_.push_back(static_cast<int>(cpu));
+        }
+    }
+
+    // cpu_capacity is the scheduler's own per-core weight on ARM; fall back to the maximum frequency
+    std::vector<long> capacity;
+    for (int cpu : topology.cpus_) {
+        const std::string dir = sysfsRoot + "/cpu" + std::to_string(cpu);
+        long value = readNumber(dir + "/cpu_capacity");
+        capacity.push_back(value > 0 ? value : readNumber(dir + "/cpufreq/cpuinfo_max_freq"));
+    }
+    const long slowest = *std::min_element(capacity.begin(), capacity.end());
+    for (size_t i = 0; i < topology.cpus_.size(); ++i) {
+        if (capacity[i] > slowest) {
+            topology.performanceCpus_.push_back(topology.cpus_[i]);
+        }
+    }
+    if (topology.performanceCpus_.empty()) {
+        topology.performanceCpus_ = topology.cpus_;
+    }
+    return topology;
+}
+
+std::vector<int> CpuTopology::parseCpuList(const std::string& list) {
+    // Kernel cpulist format, e.g. "0-3,6,8-11"
+    std::vector<int> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        int first = 0;
+        int last = 0;
+        char dash = 0;
+        std::stringstream parser(range);
+        if (!(parser >> first)) {
+            continue;
+        }
+        if (!(parser >> dash >> last) || dash != '-') {
+            last = first;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
@@ -0,0 +1,25 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+// Online CPUs grouped by capacity, read from /sys/devices/system/cpu. On big.LITTLE SoCs the
+// performance cores are every core faster than the slowest cluster; on homogeneous systems (or when
+// sysfs reports nothing useful) every online core counts as a performance core.
+class CpuTopology {
+public:
+    static CpuTopology detect(const std::string& sysfsRoot = "/sys/devices/system/cpu");
+
+    const std::vector<int>& cpus() const { return cpus_; }
+    const std::vector<int>& performanceCpus() const { return performanceCpus_; }
+    bool heterogeneous() const { return performanceCpus_.size() < cpus_.size(); }
+
+private:
+    std::vector<int> cpus_;
+    std::vector<int> performanceCpus_;
+
+    static std::vector<int> parseCpuList(const std::string& list);
+};
+
+#endif // CPU_TOPOLOGY_H
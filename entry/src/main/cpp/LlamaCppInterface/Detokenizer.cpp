@@ -0,0 +1,70 @@
+#include "Detokenizer.h"
+#include <cstring>
+
+Detokenizer::Detokenizer(size_t reserveBytes) : vocab_(nullptr), buffer_(reserveBytes), pending_(0) {
+    text_.reserve(reserveBytes);
+}
+
+void Detokenizer::reset(const llama_vocab* vocab) {
+    vocab_ = vocab;
+    pending_ = 0;
+    text_.clear();
+}
+
+const std::string& Detokenizer::push(llama_token token) {
+    // Write the piece behind the held-back bytes; a negative result is the size the piece needs
+    int n = llama_token_to_piece(vocab_, token, buffer_.data() + pending_,
+                                 static_cast<int32_t>(buffer_.size() - pending_), 0, true);
+    if (n < 0) {
+        buffer_.resize(pending_ + static_cast<size_t>(-n));
+        n = llama_token_to_piece(vocab_, token, buffer_.data() + pending_,
+                                 static_cast<int32_t>(buffer_.size() - pending_), 0, true);
+    }
+
+    const size_t size = pending_ + (n > 0 ? static_cast<size_t>(n) : 0);
+    const size_t complete = completePrefix(buffer_.data(), size);
+    text_.assign(buffer_.data(), complete);
+    pending_ = size - complete;
+    if (pending_ > 0) {
+        memmove(buffer_.data(), buffer_.data() + complete, pending_);
+    }
+    return text_;
+}
+
+const std::string& Detokenizer::flush() {
+    text_.assign(buffer_.data(), pending_);
+    pending_ = 0;
+    return text_;
+}
+
+std::string Detokenizer::toText(const llama_vocab* vocab, const std::vector<llama_token>& tokens) {
+    Detokenizer detokenizer;
+    detokenizer.reset(vocab);
+    std::string result;
+    for (llama_token token : tokens) {
+        result += detokenizer.push(token);
+    }
+    result += detokenizer.flush();
+    return result;
+}
+
+size_t Detokenizer::completePrefix(const char* data, size_t size) {
+    // Only the last three bytes can belong to an unfinished character; find its lead byte
+    for (size_t back = 1; back <= 3 && back <= size; ++back) {
+        const unsigned char c = static_cast<unsigned char>(data[size - back]);
+        if ((c & 0xC0) == 0x80) {
+            continue;  // continuation byte, keep looking for the lead
+        }
+        size_t length = 1;
+        if ((c & 0xE0) == 0xC0) {
+            length = 2;
+        } else if ((c & 0xF0) == 0xE0) {
+            length = 3;
+        } else if ((c & 0xF8) == 0xF0) {
+            length = 4;
+        }
+        return length > back ? size - back : size;
+    }
+    // ASCII tail, or stray continuation bytes that no later token can complete
+    return size;
+}
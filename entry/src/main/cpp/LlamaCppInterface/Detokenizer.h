@@ -0,0 +1,36 @@
+#ifndef DETOKENIZER_H
+#define DETOKENIZER_H
+
+#include <string>
+#include <vector>
+
+#include "llama.h"
+
+// Turns a stream of sampled tokens into text that only ever ends on a complete UTF-8 codepoint.
+// Bytes of a character split across tokens are held back until the token that completes it arrives.
+// Buffers grow to the longest piece seen and are reused, so push() does not allocate in steady state.
+class Detokenizer {
+public:
+    explicit Detokenizer(size_t reserveBytes = 256);
+
+    // Binds the vocabulary of the next stream and drops any held-back bytes
+    void reset(const llama_vocab* vocab);
+
+    // Returns the text completed by token; valid until the next call. Empty while a character is pending.
+    const std::string& push(llama_token token);
+    // Returns the bytes still held back when the stream ends (an unfinished character) and clears them
+    const std::string& flush();
+
+    // Whole-sequence conversion for tokens that are not streamed
+    static std::string toText(const llama_vocab* vocab, const std::vector<llama_token>& tokens);
+
+private:
+    const llama_vocab* vocab_;
+    std::vector<char> buffer_;  // held-back bytes followed by the newest piece
+    size_t pending_;
+    std::string text_;
+
+    static size_t completePrefix(const char* data, size_t size);
+};
+
+#endif // DETOKENIZER_H
@@ -3,248 +3,2569 @@
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <cstdint>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// System prompts shorter than this are cheaper to prefill than to restore from disk
+const size_t kMinCachedPrefixTokens = 32;
+
+// Texts embedded together in one llama_decode call
+const uint32_t kMaxEmbedSequences = 64;
+
+// Completions decoded together by generateBatch()
+const uint32_t kMaxBatchSequences = 16;
+
+// Cells a sequence must hold before its state size is used to measure the KV cache; fewer would let the
+// per-sequence metadata skew the per-cell size
+const size_t kMinKvMeasureCells = 32;
+
+// Initial K and V buffer size of a context with nCtx cells, assuming head_dim = n_embd / n_head, which
+// llama.h gives no way to check. measureKvCache() replaces it once a prefill has filled some cells.
+size_t kvCacheBytes(const llama_model* model, uint32_t nCtx, enum ggml_type typeK, enum ggml_type typeV) {
+    const int64_t nHead = llama_model_n_head(model);
+    const int64_t nEmbdKv = nHead > 0 ? llama_model_n_embd(model) / nHead * llama_model_n_head_kv(model) : 0;
+    return static_cast<size_t>(llama_model_n_layer(model)) * nCtx *
+           (ggml_row_size(typeK, nEmbdKv) + ggml_row_size(typeV, nEmbdKv));
+}
+
+// Device, inode, size and mtime of the file at path, empty if it cannot be stat'ed. Fine-tunes of one
+// base share every llama_model_* property, so prefix cache keys identify weights by their file.
+std::string fileIdentity(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return "";
+    }
+    return std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) + ":" +
+           std::to_string(st.st_mtime);
+}
+
+void batchAdd(llama_batch& batch, llama_token token, llama_pos pos, llama_seq_id seqId, bool logits) {
+    batch.token[batch.n_tokens] = token;
+    batch.pos[batch.n_tokens] = pos;
+    batch.n_seq_id[batch.n_tokens] = 1;
+    batch.seq_id[batch.n_tokens][0] = seqId;
+    batch.logits[batch.n_tokens] = logits;
+    batch.n_tokens++;
+}
+
+} // namespace
 
 LlamaCppInterface::LlamaCppInterface() 
-    : model_(nullptr), context_(nullptr), modelLoaded_(false) {
+    : model_(nullptr), context_(nullptr), draftModel_(nullptr), draftContext_(nullptr), draftSampler_(nullptr),
+      draftTokens_(0), embedContext_(nullptr), batchContext_(nullptr), prefillThreadpool_(nullptr),
+      decodeThreadpool_(nullptr), kvCacheBytes_(0), kvStateBaseBytes_(0), kvMeasured_(false), prefillThreads_(0),
+      decodeThreads_(0), cpuTopology_(CpuTopology::detect()),
+      modelFd_(-1),
+      modelLoaded_(false), loadInProgress_(false), loadCancelRequested_(false), abortRequested_(false),
+      abortArmed_(false), lastCancelled_(false), abortDeadline_(INT64_MAX), deadlineReason_(FinishReason::Stop),
+      lastFinishReason_(FinishReason::Stop), prefillProcessed_(0), prefillTotal_(0), schedulerStop_(false) {
     // Initialize llama.cpp backend
     llama_backend_init();
     ggml_backend_load_all();
 }
 
-LlamaCppInterface::~LlamaCppInterface() {
-    unloadModel();
-    llama_backend_free();
+LlamaCppInterface::~LlamaCppInterface() {
+    unloadModel();
+    modelPool_.reset();
+    llama_backend_free();
+}
+
+bool LlamaCppInterface::loadModel(const std::string& modelPath, int contextSize, int threads) {
+    LoadConfig config;
+    config.contextSize = contextSize;
+    config.threads = threads;
+    return loadModel(modelPath, config);
+}
+
+bool LlamaCppInterface::loadModel(const std::string& modelPath, const LoadConfig& config) {
+    return loadModelOwningFd(modelPath, config, -1);
+}
+
+// ownedFd (-1 if none) belongs to the model from the moment the previous one is unloaded, so no unload
+// or reload in between can miss it: a failed load closes it, otherwise unloadModel() does
+bool LlamaCppInterface::loadModelOwningFd(const std::string& modelPath, const LoadConfig& config, int ownedFd) {
+    if (modelLoaded_) {
+        unloadModel();
+    }
+
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    modelFd_ = ownedFd;
+
+    // Reject KV cache options llama.cpp would only fail on after the model is read
+    std::string kvError;
+    llama_context_params kvParams = llama_context_default_params();
+    if (!setupKvCache(config, kvParams, kvError)) {
+        setError(kvError);
+        closeModelFd();
+        return false;
+    }
+
+    // Set up model parameters
+    llama_model_params model_params = modelParams(config);
+    
+    // Load the model
+    beginLoad();
+    model_ = acquireModel(modelPath, model_params);
+    loadProgress_ = nullptr;
+    if (!model_) {
+        setError(endLoad() ? "Model load cancelled" : "Failed to load model from: " + modelPath);
+        closeModelFd();
+        return false;
+    }
+
+    // Undoes the load up to wherever it stopped; loadDraftModel() leaves nothing behind when it fails
+    auto abandonLoad = [this]() {
+        if (draftSampler_) {
+            llama_sampler_free(draftSampler_);
+            draftSampler_ = nullptr;
+        }
+        if (draftContext_) {
+            llama_free(draftContext_);
+            draftContext_ = nullptr;
+        }
+        if (draftModel_) {
+            releaseModel(draftModel_);
+            draftModel_ = nullptr;
+        }
+        if (context_) {
+            llama_free(context_);
+            context_ = nullptr;
+        }
+        releaseModel(model_);
+        model_ = nullptr;
+        freeThreadpools();
+        closeModelFd();
+    };
+
+    createThreadpools(config);
+
+    if (!createContext(config) || (!config.draftModelPath.empty() && !loadDraftModel(config))) {
+        abandonLoad();
+        endLoad();
+        return false;
+    }
+    // The loader only polls for a cancel while it reads tensors; one that came during a pool hit,
+    // context creation or the draft load is honored here
+    if (endLoad()) {
+        abandonLoad();
+        setError("Model load cancelled");
+        return false;
+    }
+
+    char desc[128];
+    llama_model_desc(model_, desc, sizeof(desc));
+    const std::string fileId = fileIdentity(modelPath);
+    modelId_ = std::string(desc) + "|" + (fileId.empty() ? modelPath : fileId);
+
+    // Chats use the model's own template when llama.cpp recognizes it
+    const char* chatTemplate = llama_model_chat_template(model_, nullptr);
+    const llama_chat_message probe = {"user", ""};
+    chatTemplate_ = chatTemplate && llama_chat_apply_template(chatTemplate, &probe, 1, true, nullptr, 0) >= 0
+                        ? chatTemplate
+                        : "";
+
+    modelLoaded_ = true;
+    modelPath_ = modelPath;
+    loadConfig_ = config;
+    loadConfig_.onProgress = nullptr;
+    defaultSession_ = Session();
+    speculativeStats_ = SpeculativeStats();
+    perfStats_ = PerfStats();
+    {
+        std::lock_guard<std::mutex> errorLock(errorMutex_);
+        lastError_.clear();
+    }
+    if (config.maxSessions > 0) {
+        startScheduler();
+    }
+    publishSnapshot();
+    return true;
+}
+
+bool LlamaCppInterface::loadModelFromFd(int fd, int64_t offset, int64_t length, const LoadConfig& config) {
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        setError("Model descriptor is not an open regular file");
+        return false;
+    }
+    if (length <= 0) {
+        length = st.st_size - offset;
+    }
+    if (offset < 0 || length <= 0 || offset + length > st.st_size) {
+        setError("Model range lies outside the file");
+        return false;
+    }
+    char magic[4] = {};
+    if (pread(fd, magic, sizeof(magic), offset) != static_cast<ssize_t>(sizeof(magic)) ||
+        memcmp(magic, "GGUF", sizeof(magic)) != 0) {
+        setError("No GGUF model at offset " + std::to_string(offset));
+        return false;
+    }
+    // llama.cpp opens models by path and reads and maps them from their first byte
+    if (offset != 0 || length != st.st_size) {
+        setError("The model is embedded at offset " + std::to_string(offset) +
+                 " of a larger file; llama.cpp can only map a GGUF that is a whole file");
+        return false;
+    }
+
+    // The duplicate keeps the file reachable for reloads after memory pressure once the caller closes fd
+    const int ownFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (ownFd < 0) {
+        setError("Failed to duplicate the model descriptor");
+        return false;
+    }
+    return loadModelOwningFd("/proc/self/fd/" + std::to_string(ownFd), config, ownFd);
+}
+
+void LlamaCppInterface::closeModelFd() {
+    if (modelFd_ >= 0) {
+        close(modelFd_);
+        modelFd_ = -1;
+    }
+}
+
+llama_model* LlamaCppInterface::acquireModel(const std::string& path, const llama_model_params& params) {
+    if (modelPool_) {
+        return modelPool_->acquire(path, params);
+    }
+    return llama_model_load_from_file(path.c_str(), params);
+}
+
+void LlamaCppInterface::releaseModel(llama_model* model) {
+    // Pooled models stay resident until the pool needs the memory
+    if (!modelPool_ || !modelPool_->release(model)) {
+        llama_model_free(model);
+    }
+}
+
+llama_model_params LlamaCppInterface::modelParams(const LoadConfig& config) {
+    llama_model_params params = llama_model_default_params();
+    params.use_mmap = config.useMmap;
+    params.use_mlock = config.useMlock;
+    params.check_tensors = config.checkTensors;
+    // The loader polls the callback between tensors, which is also where a load can be cancelled
+    loadProgress_ = config.onProgress;
+    params.progress_callback = loadProgressCallback;
+    params.progress_callback_user_data = this;
+    return params;
+}
+
+bool LlamaCppInterface::loadProgressCallback(float progress, void* data) {
+    auto* self = static_cast<LlamaCppInterface*>(data);
+    if (self->loadCancelRequested_) {
+        return false;
+    }
+    if (self->loadProgress_ && !self->loadProgress_(progress)) {
+        self->loadCancelRequested_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool LlamaCppInterface::createContext(const LoadConfig& config) {
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = config.contextSize;
+    setupThreads(ctx_params);
+    std::string kvError;
+    setupKvCache(config, ctx_params, kvError);
+    // n_batch bounds how many prompt tokens one llama_decode call takes; n_ubatch sizes the compute
+    // buffers. Smaller values lower peak memory at the cost of prefill throughput.
+    ctx_params.n_batch = std::max(1, std::min(config.batchSize, config.contextSize));
+    ctx_params.n_ubatch = std::max(1, std::min(config.ubatchSize, static_cast<int>(ctx_params.n_batch)));
+    ctx_params.n_seq_max = 1 + std::max(0, config.maxSessions);
+    ctx_params.kv_unified = true;
+    // Keep llama.cpp's eval timers running for getPerfStats()
+    ctx_params.no_perf = false;
+
+    context_ = llama_init_from_model(model_, ctx_params);
+    if (!context_) {
+        setError("Failed to create context");
+        return false;
+    }
+    attachThreadpools(context_);
+    attachLoraAdapters(context_);
+    // Let requestAbort() interrupt llama_decode between graph nodes
+    llama_set_abort_callback(context_, abortCallback, this);
+    kvCacheBytes_ = kvCacheBytes(model_, llama_n_ctx(context_), ctx_params.type_k, ctx_params.type_v);
+    kvStateBaseBytes_ = llama_state_seq_get_size(context_, defaultSession_.seqId);
+    kvMeasured_ = false;
+    return true;
+}
+
+bool LlamaCppInterface::loadDraftModel(const LoadConfig& config) {
+    LoadConfig draftConfig = config;
+    draftConfig.onProgress = nullptr;
+    draftModel_ = acquireModel(config.draftModelPath, modelParams(draftConfig));
+    if (!draftModel_) {
+        setError(loadCancelRequested_ ? "Model load cancelled"
+                                      : "Failed to load draft model from: " + config.draftModelPath);
+        return false;
+    }
+
+    // Draft tokens are fed to the target as-is, so both models must share one vocabulary
+    const llama_vocab* vocab = llama_model_get_vocab(model_);
+    const llama_vocab* draftVocab = llama_model_get_vocab(draftModel_);
+    if (llama_vocab_n_tokens(vocab) != llama_vocab_n_tokens(draftVocab) ||
+        llama_vocab_bos(vocab) != llama_vocab_bos(draftVocab) ||
+        llama_vocab_get_add_bos(vocab) != llama_vocab_get_add_bos(draftVocab)) {
+        setError("Draft model vocabulary does not match the target model");
+        releaseModel(draftModel_);
+        draftModel_ = nullptr;
+        return false;
+    }
+    if (!createDraftContext(config)) {
+        releaseModel(draftModel_);
+        draftModel_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool LlamaCppInterface::createDraftContext(const LoadConfig& config) {
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = config.contextSize;
+    setupThreads(ctx_params);
+    std::string kvError;
+    setupKvCache(config, ctx_params, kvError);
+    ctx_params.n_batch = std::max(1, std::min(config.batchSize, config.contextSize));
+    ctx_params.n_ubatch = std::max(1, std::min(config.ubatchSize, static_cast<int>(ctx_params.n_batch)));
+    draftContext_ = llama_init_from_model(draftModel_, ctx_params);
+    if (!draftContext_) {
+        setError("Failed to create draft context");
+        return false;
+    }
+    attachThreadpools(draftContext_);
+
+    // The draft only proposes tokens; the target's sampler decides what is kept
+    draftSampler_ = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    llama_sampler_chain_add(draftSampler_, llama_sampler_init_greedy());
+
+    // [last sampled token, draft...] must fit in one target batch
+    const size_t maxDraft = llama_n_batch(context_) > 1 ? llama_n_batch(context_) - 1 : 0;
+    draftTokens_ = std::min(static_cast<size_t>(std::max(0, config.draftTokens)), maxDraft);
+    draftCachedTokens_.clear();
+    return true;
+}
+
+void LlamaCppInterface::createThreadpools(const LoadConfig& config) {
+    prefillThreads_ = std::max(1, config.prefillThreads > 0 ? config.prefillThreads : config.threads);
+    decodeThreads_ = std::max(1, config.decodeThreads > 0 ? config.decodeThreads : config.threads);
+
+    // Explicit pools keep the workers on the chosen cores instead of letting the kernel migrate
+    // decode threads onto little cores between tokens
+    auto create = [&](int nThreads) {
+        ggml_threadpool_params params = ggml_threadpool_params_default(nThreads);
+        params.prio = config.threadPriority;
+        params.poll = std::min(config.pollLevel, 100u);
+        if (config.pinThreads && cpuTopology_.heterogeneous()) {
+            const std::vector<int>& performance = cpuTopology_.performanceCpus();
+            const std::vector<int>& cpus =
+                nThreads <= static_cast<int>(performance.size()) ? performance : cpuTopology_.cpus();
+            for (int cpu : cpus) {
+                if (cpu < GGML_MAX_N_THREADS) {
+                    params.cpumask[cpu] = true;
+                }
+            }
+        }
+        return ggml_threadpool_new(&params);
+    };
+    prefillThreadpool_ = create(prefillThreads_);
+    decodeThreadpool_ = create(decodeThreads_);
+
+    // Without pools llama.cpp falls back to its own per-call threads
+    if (!prefillThreadpool_ || !decodeThreadpool_) {
+        freeThreadpools();
+    }
+}
+
+void LlamaCppInterface::freeThreadpools() {
+    if (prefillThreadpool_) {
+        ggml_threadpool_free(prefillThreadpool_);
+        prefillThreadpool_ = nullptr;
+    }
+    if (decodeThreadpool_) {
+        ggml_threadpool_free(decodeThreadpool_);
+        decodeThreadpool_ = nullptr;
+    }
+}
+
+void LlamaCppInterface::setupThreads(llama_context_params& params) const {
+    // Single-token decodes run on n_threads, prompt batches on n_threads_batch
+    params.n_threads = decodeThreads_;
+    params.n_threads_batch = prefillThreads_;
+}
+
+bool LlamaCppInterface::setupKvCache(const LoadConfig& config, llama_context_params& params, std::string& error) {
+    auto supported = [](enum ggml_type type) {
+        return type == GGML_TYPE_F16 || type == GGML_TYPE_Q8_0 || type == GGML_TYPE_Q4_0;
+    };
+    if (!supported(config.kvCacheTypeK) || !supported(config.kvCacheTypeV)) {
+        error = "KV cache types must be F16, Q8_0 or Q4_0";
+        return false;
+    }
+    if (config.kvCacheTypeV != GGML_TYPE_F16 && config.flashAttention == LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+        error = "A quantized V cache requires flash attention";
+        return false;
+    }
+    params.type_k = config.kvCacheTypeK;
+    params.type_v = config.kvCacheTypeV;
+    params.flash_attn_type = config.flashAttention;
+    params.offload_kqv = config.offloadKv;
+    params.defrag_thold = config.defragThreshold;
+    return true;
+}
+
+void LlamaCppInterface::attachThreadpools(llama_context* context) const {
+    if (decodeThreadpool_ && prefillThreadpool_) {
+        llama_attach_threadpool(context, decodeThreadpool_, prefillThreadpool_);
+    }
+}
+
+void LlamaCppInterface::unloadModel() {
+    stopScheduler();
+
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    if (embedContext_) {
+        llama_free(embedContext_);
+        embedContext_ = nullptr;
+    }
+    if (batchContext_) {
+        llama_free(batchContext_);
+        batchContext_ = nullptr;
+    }
+    if (draftSampler_) {
+        llama_sampler_free(draftSampler_);
+        draftSampler_ = nullptr;
+    }
+    if (draftContext_) {
+        llama_free(draftContext_);
+        draftContext_ = nullptr;
+    }
+    if (draftModel_) {
+        releaseModel(draftModel_);
+        draftModel_ = nullptr;
+    }
+    draftCachedTokens_.clear();
+    if (context_) {
+        llama_free(context_);
+        context_ = nullptr;
+    }
+    freeLoraAdapters();
+    if (model_) {
+        releaseModel(model_);
+        model_ = nullptr;
+    }
+    freeThreadpools();
+    closeModelFd();
+    if (!loadConfig_.spillDirectory.empty()) {
+        for (llama_seq_id seqId = 0; seqId <= loadConfig_.maxSessions; ++seqId) {
+            std::remove(spillPath(seqId).c_str());
+        }
+    }
+    modelLoaded_ = false;
+    defaultSession_ = Session();
+    publishSnapshot();
+}
+
+bool LlamaCppInterface::isModelLoaded() const {
+    return modelLoaded_;
+}
+
+std::string LlamaCppInterface::generateText(const std::string& prompt, int maxTokens, std::optional<float> temperature,
+                                            std::optional<float> topP, const TokenCallback& onToken) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    if (!ensureResident()) {
+        return "";
+    }
+
+    lastCancelled_ = false;
+    lastFinishReason_ = FinishReason::Error;
+
+    // Tokenize the prompt
+    std::vector<llama_token> tokens = tokenize(prompt);
+    if (tokens.empty()) {
+        setError("Failed to tokenize prompt");
+        return "";
+    }
+
+    // Keep the BOS token pinned if the context has to be shifted during generation
+    size_t nKeep = llama_vocab_get_add_bos(llama_model_get_vocab(model_)) ? 1 : 0;
+    // Rebuild the chain only when the caller actually changes the parameters; omitted ones keep the
+    // values set by setSamplerConfig()
+    applyPendingSamplerConfig();
+    SamplerConfig& samplerConfig = defaultSession_.samplerConfig;
+    if ((temperature && samplerConfig.temperature != *temperature) || (topP && samplerConfig.topP != *topP)) {
+        samplerConfig.temperature = temperature.value_or(samplerConfig.temperature);
+        samplerConfig.topP = topP.value_or(samplerConfig.topP);
+        defaultSession_.sampler.reset();
+    }
+    defaultSession_.stopMatcher.setStops(samplerConfig.stopStrings, samplerConfig.stopTokens);
+    armRequest();
+    return generateTokens(tokens, maxTokens, onToken, nKeep, nullptr);
+}
+
+// The caller has armed the request with armRequest(); it is disarmed again before this returns
+std::string LlamaCppInterface::generateTokens(const std::vector<llama_token>& promptTokens, int maxTokens,
+                                              const TokenCallback& onToken, size_t nKeep,
+                                              std::vector<llama_token>* generated) {
+    const llama_vocab* vocab = llama_model_get_vocab(model_);
+    const size_t nCtx = sequenceBudget();
+    Session& session = defaultSession_;
+
+    if (promptTokens.size() >= nCtx) {
+        setError("Prompt does not fit in the context window");
+        disarmRequest();
+        return "";
+    }
+
+    const Clock::time_point requestStart = Clock::now();
+    llama_perf_context_reset(context_);
+
+    llama_sampler* sampler = prepareSampler(session, promptTokens);
+    session.detokenizer.reset(vocab);
+
+    // Only prefill the part of the prompt that is not already in the KV cache, n_batch tokens at a time
+    size_t n_past = reuseCachedPrefix(session, promptTokens);
+    int ret = prefillTokens(session, promptTokens, n_past);
+    if (ret != 0) {
+        if (!(ret == 2 && recordInterruption())) {
+            lastFinishReason_ = FinishReason::Error;
+            setError("Failed to process prompt tokens");
+        }
+        disarmRequest();
+        return "";
+    }
+    const Clock::time_point prefillEnd = Clock::now();
+    armDeadline(FinishReason::TokenDeadline);
+    lastFinishReason_ = FinishReason::Length;
+
+    // Time to first token is measured when the first piece is handed out
+    Clock::time_point firstToken = prefillEnd;
+    bool gotFirstToken = false;
+    auto timedOnToken = [&](const std::string& piece) {
+        if (!gotFirstToken) {
+            firstToken = Clock::now();
+            gotFirstToken = true;
+        }
+        return !onToken || onToken(piece);
+    };
+
+    // Generate tokens
+    std::string result;
+    int nGenerated = 0;
+    const bool speculative = draftContext_ && draftTokens_ > 0 && maxTokens > 0;
+    if (speculative) {
+        nGenerated = speculativeDecode(session, sampler, maxTokens, timedOnToken, nKeep, generated, result);
+    }
+    for (int i = 0; !speculative && i < maxTokens; ++i) {
+        if (recordInterruption()) {
+            break;
+        }
+
+        llama_token new_token_id = llama_sampler_sample(sampler, context_, -1);
+        
+        if (llama_vocab_is_eog(vocab, new_token_id) || session.stopMatcher.isStopToken(new_token_id)) {
+            lastFinishReason_ = FinishReason::Stop;
+            break;
+        }
+        if (generated) {
+            generated->push_back(new_token_id);
+        }
+        ++nGenerated;
+        armDeadline(FinishReason::TokenDeadline);
+
+        // Convert token to text; a character split across tokens is handed out once it is complete,
+        // and text that may be the start of a stop string once it turns out not to be
+        const std::string& piece = session.stopMatcher.push(session.detokenizer.push(new_token_id));
+        if (!piece.empty()) {
+            result += piece;
+            if (!timedOnToken(piece)) {
+                lastFinishReason_ = FinishReason::Stop;
+                break;
+            }
+        }
+        if (session.stopMatcher.matched()) {
+            lastFinishReason_ = FinishReason::Stop;
+            break;
+        }
+
+        // Make room by shifting the KV cache instead of failing when the context is full
+        if (session.cachedTokens.size() + 1 >= nCtx && !shiftContext(session, nKeep)) {
+            lastFinishReason_ = FinishReason::Error;
+            setError("Context window is full");
+            break;
+        }
+
+        // Prepare the next token for decoding
+        llama_batch next_batch = llama_batch_get_one(&new_token_id, 1);
+        ret = llama_decode(context_, next_batch);
+        if (ret != 0) {
+            if (!(ret == 2 && recordInterruption())) {
+                lastFinishReason_ = FinishReason::Error;
+                setError("Failed to decode token");
+            }
+            llama_memory_seq_rm(llama_get_memory(context_), session.seqId, session.cachedTokens.size(), -1);
+            break;
+        }
+        session.cachedTokens.push_back(new_token_id);
+    }
+    const std::string& tail = session.stopMatcher.finish(session.detokenizer.flush());
+    if (!tail.empty()) {
+        result += tail;
+        timedOnToken(tail);
+    }
+    const Clock::time_point requestEnd = Clock::now();
+
+    RequestPerf perf;
+    perf.promptTokens = promptTokens.size();
+    perf.prefilledTokens = promptTokens.size() - n_past;
+    perf.generatedTokens = nGenerated;
+    perf.prefillMs = elapsedMs(requestStart, prefillEnd);
+    perf.decodeMs = elapsedMs(prefillEnd, requestEnd);
+    perf.ttftMs = elapsedMs(requestStart, gotFirstToken ? firstToken : requestEnd);
+    const llama_perf_sampler_data samplerPerf = llama_perf_sampler(sampler);
+    perf.samplingMs = samplerPerf.t_sample_ms;
+    perf.sampledTokens = samplerPerf.n_sample;
+    const llama_perf_context_data evalPerf = llama_perf_context(context_);
+    perf.prefillEvalMs = evalPerf.t_p_eval_ms;
+    perf.decodeEvalMs = evalPerf.t_eval_ms;
+    perfStats_.last = perf;
+    perfStats_.total.promptTokens += perf.promptTokens;
+    perfStats_.total.prefilledTokens += perf.prefilledTokens;
+    perfStats_.total.generatedTokens += perf.generatedTokens;
+    perfStats_.total.prefillMs += perf.prefillMs;
+    perfStats_.total.decodeMs += perf.decodeMs;
+    perfStats_.total.ttftMs += perf.ttftMs;
+    perfStats_.total.samplingMs += perf.samplingMs;
+    perfStats_.total.sampledTokens += perf.sampledTokens;
+    perfStats_.total.prefillEvalMs += perf.prefillEvalMs;
+    perfStats_.total.decodeEvalMs += perf.decodeEvalMs;
+    perfStats_.requests++;
+    publishSnapshot();
+
+    disarmRequest();
+    return result;
+}
+
+bool LlamaCppInterface::ensureBatchContext() {
+    if (batchContext_) {
+        return true;
+    }
+
+    // A unified KV cache lets the forked sequences share the prefix cells instead of copying them
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = loadConfig_.contextSize;
+    ctx_params.n_batch = std::max(1, std::min(loadConfig_.batchSize, loadConfig_.contextSize));
+    ctx_params.n_ubatch = std::max(1, std::min(loadConfig_.ubatchSize, static_cast<int>(ctx_params.n_batch)));
+    ctx_params.n_seq_max = kMaxBatchSequences;
+    setupThreads(ctx_params);
+    std::string kvError;
+    setupKvCache(loadConfig_, ctx_params, kvError);
+    ctx_params.kv_unified = true;
+    batchContext_ = llama_init_from_model(model_, ctx_params);
+    if (!batchContext_) {
+        setError("Failed to create batch context");
+        return false;
+    }
+    attachThreadpools(batchContext_);
+    attachLoraAdapters(batchContext_);
+    llama_set_abort_callback(batchContext_, abortCallback, this);
+    return true;
+}
+
+std::vector<std::string> LlamaCppInterface::generateBatch(const std::vector<std::string>& prompts, int maxTokens,
+                                                          const std::vector<std::string>& stopStrings) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    if (!ensureResident()) {
+        return {};
+    }
+    if (prompts.empty() || prompts.size() > kMaxBatchSequences) {
+        setError("generateBatch takes 1 to " + std::to_string(kMaxBatchSequences) + " prompts");
+        return {};
+    }
+    lastCancelled_ = false;
+    applyPendingSamplerConfig();
+
+    // Per-sequence state
+    struct Sequence {
+        std::vector<llama_token> tokens;
+        llama_sampler* sampler = nullptr;
+        llama_token lastToken = 0;
+        llama_pos nPast = 0;
+        int32_t iBatch = -1;
+        int generated = 0;
+        Detokenizer detokenizer;
+        StopMatcher stopMatcher;
+        std::string text;
+        bool done = false;
+    };
+    const size_t nSeq = prompts.size();
+    std::vector<Sequence> seqs(nSeq);
+    size_t nPrefix = SIZE_MAX;
+    size_t nTotal = 0;
+    for (size_t i = 0; i < nSeq; ++i) {
+        seqs[i].tokens = tokenize(prompts[i]);
+        if (seqs[i].tokens.empty()) {
+            setError("Failed to tokenize prompt");
+            return {};
+        }
+        if (i == 0) {
+            nPrefix = seqs[0].tokens.size();
+        } else {
+            size_t n = 0;
+            while (n < nPrefix && n < seqs[i].tokens.size() && seqs[i].tokens[n] == seqs[0].tokens[n]) {
+                ++n;
+            }
+            nPrefix = n;
+        }
+    }
+    // Every sequence decodes at least its last prompt token itself so it gets its own logits
+    for (const Sequence& seq : seqs) {
+        nPrefix = std::min(nPrefix, seq.tokens.size() - 1);
+    }
+    nTotal = nPrefix;
+    for (const Sequence& seq : seqs) {
+        nTotal += seq.tokens.size() - nPrefix + std::max(0, maxTokens);
+    }
+    if (!ensureBatchContext()) {
+        return {};
+    }
+    if (nTotal > llama_n_ctx(batchContext_)) {
+        setError("Prompts and completions do not fit in the context window");
+        return {};
+    }
+    if (maxTokens <= 0) {
+        return std::vector<std::string>(nSeq);
+    }
+
+    const llama_vocab* vocab = llama_model_get_vocab(model_);
+    const int32_t nBatch = static_cast<int32_t>(llama_n_batch(batchContext_));
+    llama_memory_t mem = llama_get_memory(batchContext_);
+    llama_memory_clear(mem, true);
+    llama_batch batch = llama_batch_init(nBatch, 0, 1);
+    abortArmed_ = true;
+
+    // Distinct seeds so identical prompts still yield different completions
+    for (size_t i = 0; i < nSeq; ++i) {
+        SamplerConfig config = defaultSession_.samplerConfig;
+        if (config.seed != LLAMA_DEFAULT_SEED) {
+            config.seed += static_cast<uint32_t>(i);
+        }
+        seqs[i].sampler = createSampler(config);
+        seqs[i].detokenizer.reset(vocab);
+        seqs[i].stopMatcher.setStops(stopStrings, {});
+        seqs[i].nPast = static_cast<llama_pos>(nPrefix);
+    }
+
+    // Samples the sequence's next token from its logits in the last batch and applies stop conditions
+    auto sampleNext = [&](Sequence& seq) {
+        llama_token token = llama_sampler_sample(seq.sampler, batchContext_, seq.iBatch);
+        seq.iBatch = -1;
+        if (llama_vocab_is_eog(vocab, token)) {
+            seq.done = true;
+            return;
+        }
+        seq.text += seq.stopMatcher.push(seq.detokenizer.push(token));
+        if (seq.stopMatcher.matched()) {
+            seq.done = true;
+            return;
+        }
+        seq.lastToken = token;
+        seq.done = ++seq.generated >= maxTokens;
+    };
+
+    std::string error;
+    auto decode = [&]() {
+        int ret = llama_decode(batchContext_, batch);
+        if (ret != 0) {
+            if (ret == 2 && abortRequested_) {
+                lastCancelled_ = true;
+                error = "Generation cancelled";
+            } else {
+                error = "Failed to decode batch";
+            }
+        }
+        batch.n_tokens = 0;
+        return ret == 0;
+    };
+    // Decodes the batch and samples every sequence whose logits it holds
+    auto decodeAndSample = [&]() {
+        if (!decode()) {
+            return false;
+        }
+        for (Sequence& seq : seqs) {
+            if (seq.iBatch >= 0) {
+                sampleNext(seq);
+            }
+        }
+        return true;
+    };
+
+    // Shared prefix once on sequence 0, then fork it to the others
+    bool ok = true;
+    for (size_t i = 0; ok && i < nPrefix; ++i) {
+        batchAdd(batch, seqs[0].tokens[i], static_cast<llama_pos>(i), 0, false);
+        if (batch.n_tokens == nBatch || i + 1 == nPrefix) {
+            ok = decode();
+        }
+    }
+    for (size_t i = 1; ok && nPrefix > 0 && i < nSeq; ++i) {
+        llama_memory_seq_cp(mem, 0, static_cast<llama_seq_id>(i), -1, -1);
+    }
+
+    // Prompt suffixes of all sequences share batches; a sequence samples its first token in the batch
+    // that holds its last prompt token
+    for (size_t i = 0; ok && i < nSeq; ++i) {
+        Sequence& seq = seqs[i];
+        for (size_t t = nPrefix; ok && t < seq.tokens.size(); ++t) {
+            const bool last = t + 1 == seq.tokens.size();
+            batchAdd(batch, seq.tokens[t], seq.nPast++, static_cast<llama_seq_id>(i), last);
+            if (last) {
+                seq.iBatch = batch.n_tokens - 1;
+            }
+            if (batch.n_tokens == nBatch || (last && i + 1 == nSeq)) {
+                ok = decodeAndSample();
+            }
+        }
+    }
+
+    // Lockstep decode: one token per unfinished sequence per step, split into batches of at most nBatch
+    // tokens when there are more sequences than the batch holds
+    while (ok) {
+        const bool active = std::any_of(seqs.begin(), seqs.end(), [](const Sequence& seq) { return !seq.done; });
+        if (!active) {
+            break;
+        }
+        if (abortRequested_) {
+            lastCancelled_ = true;
+            error = "Generation cancelled";
+            break;
+        }
+        for (size_t i = 0; ok && i < nSeq; ++i) {
+            Sequence& seq = seqs[i];
+            if (seq.done) {
+                continue;
+            }
+            batchAdd(batch, seq.lastToken, seq.nPast++, static_cast<llama_seq_id>(i), true);
+            seq.iBatch = batch.n_tokens - 1;
+            if (batch.n_tokens == nBatch) {
+                ok = decodeAndSample();
+            }
+        }
+        if (ok && batch.n_tokens > 0) {
+            ok = decodeAndSample();
+        }
+    }
+
+    abortRequested_ = false;
+    abortArmed_ = false;
+    llama_batch_free(batch);
+    llama_memory_clear(mem, false);
+
+    std::vector<std::string> results;
+    for (Sequence& seq : seqs) {
+        llama_sampler_free(seq.sampler);
+        seq.text += seq.stopMatcher.finish(seq.detokenizer.flush());
+        results.push_back(seq.text);
+    }
+    if (!error.empty()) {
+        setError(error);
+        return {};
+    }
+    return results;
+}
+
+bool LlamaCppInterface::ensureEmbeddingContext(enum llama_pooling_type pooling) {
+    if (embedContext_ && llama_pooling_type(embedContext_) == pooling) {
+        return true;
+    }
+    if (embedContext_) {
+        llama_free(embedContext_);
+        embedContext_ = nullptr;
+    }
+
+    // Non-causal models need a whole sequence in one ubatch, so the batch spans the context
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = loadConfig_.contextSize;
+    ctx_params.n_batch = loadConfig_.contextSize;
+    ctx_params.n_ubatch = loadConfig_.contextSize;
+    ctx_params.n_seq_max = kMaxEmbedSequences;
+    setupThreads(ctx_params);
+    std::string kvError;
+    setupKvCache(loadConfig_, ctx_params, kvError);
+    ctx_params.embeddings = true;
+    ctx_params.pooling_type = pooling;
+    ctx_params.kv_unified = true;
+    embedContext_ = llama_init_from_model(model_, ctx_params);
+    if (!embedContext_) {
+        setError("Failed to create embeddings context");
+        return false;
+    }
+    attachThreadpools(embedContext_);
+    attachLoraAdapters(embedContext_);
+    return true;
+}
+
+bool LlamaCppInterface::embed(const std::vector<std::string>& texts, enum llama_pooling_type pooling,
+                              std::vector<float>& output, int& nEmbd) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    if (!ensureResident()) {
+        return false;
+    }
+    if (pooling != LLAMA_POOLING_TYPE_MEAN && pooling != LLAMA_POOLING_TYPE_CLS &&
+        pooling != LLAMA_POOLING_TYPE_LAST) {
+        setError("Unsupported pooling type");
+        return false;
+    }
+    if (!ensureEmbeddingContext(pooling)) {
+        return false;
+    }
+
+    nEmbd = llama_model_n_embd(model_);
+    output.assign(texts.size() * nEmbd, 0.0f);
+    const size_t nBatch = llama_n_batch(embedContext_);
+    llama_batch batch = llama_batch_init(static_cast<int32_t>(nBatch), 0, 1);
+    llama_memory_t mem = llama_get_memory(embedContext_);
+
+    // Decodes the texts packed so far and copies out one pooled vector per sequence
+    size_t first = 0;
+    auto flush = [&](size_t end) {
+        if (mem) {
+            llama_memory_clear(mem, true);
+        }
+        if (llama_decode(embedContext_, batch) != 0) {
+            setError("Failed to compute embeddings");
+            return false;
+        }
+        for (size_t i = first; i < end; ++i) {
+            const float* embedding = llama_get_embeddings_seq(embedContext_, static_cast<llama_seq_id>(i - first));
+            if (!embedding) {
+                setError("Failed to get embeddings");
+                return false;
+            }
+            double norm = 0.0;
+            for (int j = 0; j < nEmbd; ++j) {
+                norm += static_cast<double>(embedding[j]) * embedding[j];
+            }
+            const float scale = norm > 0.0 ? static_cast<float>(1.0 / std::sqrt(norm)) : 0.0f;
+            float* out = output.data() + i * nEmbd;
+            for (int j = 0; j < nEmbd; ++j) {
+                out[j] = embedding[j] * scale;
+            }
+        }
+        batch.n_tokens = 0;
+        first = end;
+        return true;
+    };
+
+    bool ok = true;
+    for (size_t i = 0; i < texts.size() && ok; ++i) {
+        std::vector<llama_token> tokens = tokenize(texts[i]);
+        if (tokens.empty()) {
+            setError("Failed to tokenize text");
+            ok = false;
+            break;
+        }
+        // A text has to fit in one batch; longer ones are truncated
+        if (tokens.size() > nBatch) {
+            tokens.resize(nBatch);
+        }
+        const size_t nSeq = i - first;
+        if (batch.n_tokens + tokens.size() > nBatch || nSeq == kMaxEmbedSequences) {
+            ok = flush(i);
+        }
+        for (size_t pos = 0; ok && pos < tokens.size(); ++pos) {
+            batchAdd(batch, tokens[pos], static_cast<llama_pos>(pos), static_cast<llama_seq_id>(i - first), true);
+        }
+    }
+    if (ok && first < texts.size()) {
+        ok = flush(texts.size());
+    }
+
+    llama_batch_free(batch);
+    if (!ok) {
+        output.clear();
+    }
+    return ok;
+}
+
+llama_sampler* LlamaCppInterface::createSampler(const SamplerConfig& config) {
+    llama_sampler_chain_params params = llama_sampler_chain_default_params();
+    params.no_perf = false;
+    llama_sampler* chain = llama_sampler_chain_init(params);
+
+    if (config.repeatPenalty != 1.0f || config.frequencyPenalty != 0.0f || config.presencePenalty != 0.0f) {
+        llama_sampler_chain_add(chain, llama_sampler_init_penalties(config.penaltyLastN, config.repeatPenalty,
+                                                                    config.frequencyPenalty, config.presencePenalty));
+    }
+    if (config.temperature <= 0.0f) {
+        llama_sampler_chain_add(chain, llama_sampler_init_greedy());
+        return chain;
+    }
+    if (config.topK > 0) {
+        llama_sampler_chain_add(chain, llama_sampler_init_top_k(config.topK));
+    }
+    if (config.typicalP < 1.0f) {
+        llama_sampler_chain_add(chain, llama_sampler_init_typical(config.typicalP, 1));
+    }
+    if (config.topP < 1.0f) {
+        llama_sampler_chain_add(chain, llama_sampler_init_top_p(config.topP, 1));
+    }
+    if (config.minP > 0.0f) {
+        llama_sampler_chain_add(chain, llama_sampler_init_min_p(config.minP, 1));
+    }
+    llama_sampler_chain_add(chain, llama_sampler_init_temp(config.temperature));
+    llama_sampler_chain_add(chain, llama_sampler_init_dist(config.seed));
+    return chain;
+}
+
+llama_sampler* LlamaCppInterface::prepareSampler(Session& session, const std::vector<llama_token>& promptTokens) {
+    if (!session.sampler) {
+        session.sampler.reset(createSampler(session.samplerConfig));
+    }
+
+    // Reset instead of rebuilding: clears penalty history and reseeds dist
+    llama_sampler* sampler = session.sampler.get();
+    llama_sampler_reset(sampler);
+    llama_perf_sampler_reset(sampler);
+
+    // Penalties also apply to tokens repeated from the prompt
+    const SamplerConfig& config = session.samplerConfig;
+    if (config.repeatPenalty != 1.0f || config.frequencyPenalty != 0.0f || config.presencePenalty != 0.0f) {
+        size_t from = 0;
+        if (config.penaltyLastN >= 0 && promptTokens.size() > static_cast<size_t>(config.penaltyLastN)) {
+            from = promptTokens.size() - config.penaltyLastN;
+        }
+        for (size_t i = from; i < promptTokens.size(); ++i) {
+            llama_sampler_accept(sampler, promptTokens[i]);
+        }
+    }
+    return sampler;
+}
+
+bool LlamaCppInterface::setSamplerConfig(const SamplerConfig& config, int sessionId) {
+    if (sessionId < 0) {
+        // The default conversation may be generating under contextMutex_; its next request picks this up
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        pendingSamplerConfig_ = std::make_unique<SamplerConfig>(config);
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(sessionMutex_);
+    auto it = sessions_.find(sessionId);
+    if (it == sessions_.end()) {
+        setError("Unknown session");
+        return false;
+    }
+    if (it->second->busy) {
+        setError("Session is busy");
+        return false;
+    }
+    it->second->samplerConfig = config;
+    it->second->sampler.reset();
+    return true;
+}
+
+// Requires contextMutex_
+void LlamaCppInterface::applyPendingSamplerConfig() {
+    std::unique_ptr<SamplerConfig> config;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        config = std::move(pendingSamplerConfig_);
+    }
+    if (config) {
+        defaultSession_.samplerConfig = *config;
+        defaultSession_.sampler.reset();
+    }
+}
+
+int LlamaCppInterface::speculativeDecode(Session& session, llama_sampler* sampler, int maxTokens,
+                                         const TokenCallback& onToken, size_t nKeep,
+                                         std::vector<llama_token>* generated, std::string& result) {
+    const llama_vocab* vocab = llama_model_get_vocab(model_);
+    const size_t nCtx = sequenceBudget();
+    llama_memory_t mem = llama_get_memory(context_);
+    llama_batch batch = llama_batch_init(static_cast<int32_t>(draftTokens_ + 1), 0, 1);
+    int nGenerated = 0;
+
+    // Hands one accepted token to the caller; returns false once generation should stop
+    auto emit = [&](llama_token token) {
+        if (llama_vocab_is_eog(vocab, token) || session.stopMatcher.isStopToken(token)) {
+            lastFinishReason_ = FinishReason::Stop;
+            return false;
+        }
+        if (generated) {
+            generated->push_back(token);
+        }
+        ++nGenerated;
+        armDeadline(FinishReason::TokenDeadline);
+        const std::string& piece = session.stopMatcher.push(session.detokenizer.push(token));
+        if (!piece.empty()) {
+            result += piece;
+            if (onToken && !onToken(piece)) {
+                lastFinishReason_ = FinishReason::Stop;
+                return false;
+            }
+        }
+        if (session.stopMatcher.matched()) {
+            lastFinishReason_ = FinishReason::Stop;
+            return false;
+        }
+        return nGenerated < maxTokens;
+    };
+
+    llama_token id = llama_sampler_sample(sampler, context_, -1);
+    while (emit(id)) {
+        if (recordInterruption()) {
+            break;
+        }
+
+        // Keep room for the whole verification batch
+        if (session.cachedTokens.size() + 1 + draftTokens_ >= nCtx && !shiftContext(session, nKeep)) {
+            lastFinishReason_ = FinishReason::Error;
+            setError("Context window is full");
+            break;
+        }
+
+        // Let the draft model guess how the target continues after id
+        size_t nDraft = std::min(draftTokens_, static_cast<size_t>(maxTokens - nGenerated));
+        std::vector<llama_token> draft = draftContinuation(session.cachedTokens, id, nDraft);
+
+        // Verify [id, draft...] with a single target decode
+        const size_t base = session.cachedTokens.size();
+        batch.n_tokens = 0;
+        batchAdd(batch, id, base, session.seqId, true);
+        for (size_t i = 0; i < draft.size(); ++i) {
+            batchAdd(batch, draft[i], base + 1 + i, session.seqId, true);
+        }
+        int ret = llama_decode(context_, batch);
+        if (ret != 0) {
+            if (!(ret == 2 && recordInterruption())) {
+                lastFinishReason_ = FinishReason::Error;
+                setError("Failed to decode token");
+            }
+            llama_memory_seq_rm(mem, session.seqId, base, -1);
+            break;
+        }
+        session.cachedTokens.push_back(id);
+
+        // Keep the longest run of draft tokens the target samples identically; the first mismatch
+        // is the target's own token and becomes the next id
+        size_t accepted = 0;
+        bool keepGoing = true;
+        llama_token next = llama_sampler_sample(sampler, context_, 0);
+        while (accepted < draft.size() && next == draft[accepted]) {
+            session.cachedTokens.push_back(next);
+            ++accepted;
+            if (!emit(next)) {
+                keepGoing = false;
+                break;
+            }
+            next = llama_sampler_sample(sampler, context_, static_cast<int32_t>(accepted));
+        }
+        speculativeStats_.drafted += draft.size();
+        speculativeStats_.accepted += accepted;
+
+        // Drop the rejected draft tokens from the target's KV cache
+        llama_memory_seq_rm(mem, session.seqId, session.cachedTokens.size(), -1);
+        if (!keepGoing) {
+            break;
+        }
+        id = next;
+    }
+
+    llama_batch_free(batch);
+    return nGenerated;
+}
+
+std::vector<llama_token> LlamaCppInterface::draftContinuation(const std::vector<llama_token>& tokens,
+                                                              llama_token last, size_t nDraft) {
+    std::vector<llama_token> draft;
+    if (nDraft == 0) {
+        return draft;
+    }
+
+    // Bring the draft KV cache in line with the target's tokens plus last
+    llama_memory_t mem = llama_get_memory(draftContext_);
+    size_t n_past = 0;
+    while (n_past < draftCachedTokens_.size() && n_past < tokens.size() &&
+           draftCachedTokens_[n_past] == tokens[n_past]) {
+        ++n_past;
+    }
+    llama_memory_seq_rm(mem, 0, n_past, -1);
+    draftCachedTokens_.resize(n_past);
+
+    std::vector<llama_token> pending(tokens.begin() + n_past, tokens.end());
+    pending.push_back(last);
+    const size_t nBatch = llama_n_batch(draftContext_);
+    for (size_t i = 0; i < pending.size(); i += nBatch) {
+        const size_t n = std::min(nBatch, pending.size() - i);
+        if (llama_decode(draftContext_, llama_batch_get_one(pending.data() + i, n)) != 0) {
+            llama_memory_seq_rm(mem, 0, draftCachedTokens_.size(), -1);
+            return draft;
+        }
+        draftCachedTokens_.insert(draftCachedTokens_.end(), pending.begin() + i, pending.begin() + i + n);
+    }
+
+    // Draft greedily, one cheap decode per token
+    const llama_vocab* vocab = llama_model_get_vocab(draftModel_);
+    llama_sampler_reset(draftSampler_);
+    for (size_t i = 0; i < nDraft; ++i) {
+        llama_token token = llama_sampler_sample(draftSampler_, draftContext_, -1);
+        draft.push_back(token);
+        if (i + 1 == nDraft || llama_vocab_is_eog(vocab, token)) {
+            break;
+        }
+        if (llama_decode(draftContext_, llama_batch_get_one(&token, 1)) != 0) {
+            llama_memory_seq_rm(mem, 0, draftCachedTokens_.size(), -1);
+            break;
+        }
+        draftCachedTokens_.push_back(token);
+    }
+    return draft;
+}
+
+std::string LlamaCppInterface::chatCompletion(const std::string& userInput, const std::string& systemPrompt,
+                                              const TokenCallback& onToken) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    if (!ensureResident()) {
+        return "";
+    }
+
+    const int maxResponseTokens = 150;
+    lastCancelled_ = false;
+    lastFinishReason_ = FinishReason::Error;
+
+    applyPendingSamplerConfig();
+    if (defaultSession_.systemTokens.empty() || systemPrompt != defaultSession_.systemPrompt) {
+        defaultSession_.systemPrompt = systemPrompt;
+        defaultSession_.systemTokens.clear();
+    }
+
+    std::vector<llama_token> userTokens;
+    std::vector<llama_token> promptTokens;
+    if (!buildChatPrompt(defaultSession_, userInput, maxResponseTokens, userTokens, promptTokens)) {
+        return "";
+    }
+    // Armed before the system prompt, whose prefill counts against the prefill and total deadlines
+    armRequest();
+    if (!primeSystemPrefix(defaultSession_) && recordInterruption()) {
+        disarmRequest();
+        return "";
+    }
+    
+    // Generate response
+    std::vector<llama_token> generated;
+    defaultSession_.stopMatcher.setStops(chatStopStrings(defaultSession_.samplerConfig),
+                                         defaultSession_.samplerConfig.stopTokens);
+    std::string response = generateTokens(promptTokens, maxResponseTokens, onToken,
+                                          defaultSession_.systemTokens.size(), &generated);
+    
+    if (!response.empty() && !lastCancelled_) {
+        appendChatTurn(defaultSession_, userInput, response, userTokens, generated);
+    }
+    
+    return response;
+}
+
+bool LlamaCppInterface::buildChatPrompt(Session& session, const std::string& userInput, int maxResponseTokens,
+                                        std::vector<llama_token>& userTokens,
+                                        std::vector<llama_token>& promptTokens) {
+    restoreSpilledSequence(session);
+
+    // The system prompt opens the transcript and stays pinned at the start of the KV cache
+    if (session.systemTokens.empty()) {
+        std::vector<llama_chat_message> system;
+        if (!session.systemPrompt.empty()) {
+            system.push_back({"system", session.systemPrompt.c_str()});
+        }
+        session.systemText = system.empty() ? "" : renderChat(system, false);
+        session.systemTokens = tokenize(session.systemText, true);
+    }
+
+    // Earlier messages keep their cached text and tokens; only the new message's part of the
+    // rendered transcript is tokenized. The oldest turns are evicted until the transcript plus the
+    // response budget fits in the sequence budget, rendering again after each one: a template that
+    // folds the system prompt into the first user message moves it into the next turn.
+    const size_t nCtx = sequenceBudget();
+    while (true) {
+        std::vector<llama_chat_message> messages = chatMessages(session);
+        messages.push_back({"user", userInput.c_str()});
+        const std::string rendered = renderChat(messages, true);
+        const std::string transcript = transcriptText(session);
+        if (commonPrefixLength(transcript, rendered) == transcript.size()) {
+            userTokens = tokenize(rendered.substr(transcript.size()), false);
+        } else {
+            userTokens = tokenize(rebaseTranscript(session, rendered), session.systemTokens.empty());
+        }
+        if (userTokens.empty()) {
+            setError("Failed to tokenize user input");
+            return false;
+        }
+
+        size_t historyTokens = 0;
+        for (const auto& turn : session.history) {
+            historyTokens += turn.tokens.size();
+        }
+        if (session.systemTokens.size() + historyTokens + userTokens.size() + maxResponseTokens <= nCtx) {
+            break;
+        }
+        if (session.history.empty()) {
+            setError("User input does not fit in the context window");
+            return false;
+        }
+        evictOldestTurn(session);
+    }
+
+    // Assemble the transcript from the cached per-turn tokens
+    promptTokens = session.systemTokens;
+    for (const auto& turn : session.history) {
+        promptTokens.insert(promptTokens.end(), turn.tokens.begin(), turn.tokens.end());
+    }
+    promptTokens.insert(promptTokens.end(), userTokens.begin(), userTokens.end());
+    return true;
+}
+
+int LlamaCppInterface::prefillTokens(Session& session, const std::vector<llama_token>& tokens, size_t from) {
+    // Decodes tokens[from..] into the session's sequence in n_batch sized chunks; the KV cache
+    // must already hold exactly tokens[0..from). Returns the llama_decode status of the last chunk.
+    const size_t nBatch = llama_n_batch(context_);
+    llama_batch batch = llama_batch_init(static_cast<int32_t>(nBatch), 0, 1);
+    int ret = 0;
+
+    prefillProcessed_ = 0;
+    prefillTotal_ = tokens.size() - from;
+    for (size_t i = from; i < tokens.size() && ret == 0;) {
+        if ((abortArmed_ && (abortRequested_ || deadlineExpired())) ||
+            (&session != &defaultSession_ && schedulerStop_)) {
+            ret = 2;
+            break;
+        }
+
+        const size_t begin = i;
+        const size_t end = std::min(tokens.size(), begin + nBatch);
+        batch.n_tokens = 0;
+        for (; i < end; ++i) {
+            batchAdd(batch, tokens[i], i, session.seqId, i + 1 == tokens.size());
+        }
+        ret = llama_decode(context_, batch);
+        if (ret == 0) {
+            session.cachedTokens.insert(session.cachedTokens.end(), tokens.begin() + begin, tokens.begin() + end);
+            prefillProcessed_ = end - from;
+            if (prefillProgress_) {
+                prefillProgress_(end - from, tokens.size() - from);
+            }
+        }
+    }
+
+    if (ret != 0) {
+        llama_memory_seq_rm(llama_get_memory(context_), session.seqId, session.cachedTokens.size(), -1);
+    } else if (!kvMeasured_) {
+        measureKvCache(session);
+    }
+    llama_batch_free(batch);
+    return ret;
+}
+
+// The K and V rows a sequence's state holds are the cache's real per-cell size: it reflects the actual
+// head dimensions, per-layer KV heads and cache types. Sliding-window layers are counted at full context.
+void LlamaCppInterface::measureKvCache(const Session& session) {
+    const size_t cells = session.cachedTokens.size();
+    if (cells < kMinKvMeasureCells) {
+        return;
+    }
+    const size_t stateBytes = llama_state_seq_get_size(context_, session.seqId);
+    if (stateBytes <= kvStateBaseBytes_) {
+        return;
+    }
+    kvCacheBytes_ = (stateBytes - kvStateBaseBytes_) / cells * llama_n_ctx(context_);
+    kvMeasured_ = true;
+}
+
+// Returns false if prefilling the prefix failed or was interrupted; the caller's prefill repeats it
+bool LlamaCppInterface::primeSystemPrefix(Session& session) {
+    const std::vector<llama_token>& prefix = session.systemTokens;
+    if (!prefixCache_ || prefix.size() < kMinCachedPrefixTokens) {
+        return true;
+    }
+
+    const std::vector<llama_token>& cached = session.cachedTokens;
+    if (cached.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), cached.begin())) {
+        return true;
+    }
+
+    // Cold sequence: restore the system prompt from disk, or prefill it on its own so it can be saved
+    llama_memory_seq_rm(llama_get_memory(context_), session.seqId, -1, -1);
+    session.cachedTokens.clear();
+    if (prefixCache_->load(context_, session.seqId, prefix, weightsId())) {
+        session.cachedTokens = prefix;
+        return true;
+    }
+    if (prefillTokens(session, prefix, 0) != 0) {
+        return false;
+    }
+    prefixCache_->save(context_, session.seqId, prefix, weightsId());
+    return true;
+}
+
+void LlamaCppInterface::appendChatTurn(Session& session, const std::string& userInput, const std::string& response,
+                                       const std::vector<llama_token>& userTokens,
+                                       const std::vector<llama_token>& generated) {
+    std::vector<llama_chat_message> messages = chatMessages(session);
+    messages.push_back({"user", userInput.c_str()});
+    const std::string open = renderChat(messages, true);
+    messages.push_back({"assistant", response.c_str()});
+    const std::string closed = renderChat(messages, false);
+
+    // The turn keeps exactly the tokens that were decoded for it, followed by the template's end of
+    // turn, which is prefilled with the next message. The reply is only re-tokenized if the template
+    // rewrites it or a stop string was cut from it.
+    ChatTurn turn;
+    turn.userInput = userInput;
+    turn.response = response;
+    const std::string transcript = transcriptText(session);
+    if (commonPrefixLength(transcript, closed) != transcript.size()) {
+        turn.text = rebaseTranscript(session, closed);
+        turn.tokens = tokenize(turn.text, session.systemTokens.empty());
+        session.history.push_back(std::move(turn));
+        return;
+    }
+    turn.text = closed.substr(transcript.size());
+    turn.tokens = userTokens;
+    std::string reply = closed.substr(commonPrefixLength(open, closed));
+    if (reply.compare(0, response.size(), response) == 0 && detokenize(generated) == response) {
+        turn.tokens.insert(turn.tokens.end(), generated.begin(), generated.end());
+        reply.erase(0, response.size());
+    }
+    std::vector<llama_token> replyTokens = tokenize(reply, false);
+    turn.tokens.insert(turn.tokens.end(), replyTokens.begin(), replyTokens.end());
+    session.history.push_back(std::move(turn));
+}
+
+std::string LlamaCppInterface::rebaseTranscript(Session& session, const std::string& rendered) {
+    // The template rendered earlier messages differently than when they were cached, e.g. it drops
+    // the reasoning of past replies. Earlier turns give up their text and tokens, the KV cache keeps
+    // at most the system prefix, and the caller tokenizes the returned rest of the render whole.
+    if (rendered.compare(0, session.systemText.size(), session.systemText) != 0) {
+        session.systemText.clear();
+        session.systemTokens.clear();
+    }
+    for (ChatTurn& turn : session.history) {
+        turn.text.clear();
+        turn.tokens.clear();
+    }
+
+    const std::vector<llama_token>& pinned = session.systemTokens;
+    std::vector<llama_token>& cached = session.cachedTokens;
+    const size_t keep =
+        cached.size() >= pinned.size() && std::equal(pinned.begin(), pinned.end(), cached.begin()) ? pinned.size() : 0;
+    llama_memory_seq_rm(llama_get_memory(context_), session.seqId, keep, -1);
+    cached.resize(keep);
+    return rendered.substr(session.systemText.size());
+}
+
+void LlamaCppInterface::evictOldestTurn(Session& session) {
+    const ChatTurn& oldest = session.history.front();
+    const size_t begin = session.systemTokens.size();
+    const size_t end = begin + oldest.tokens.size();
+    std::vector<llama_token>& cached = session.cachedTokens;
+    llama_memory_t mem = llama_get_memory(context_);
+
+    // If the KV cache holds exactly [system][oldest turn]..., drop that span and slide the rest back
+    // so the remaining history does not have to be prefilled again
+    bool inCache = cached.size() >= end &&
+                   std::equal(session.systemTokens.begin(), session.systemTokens.end(), cached.begin()) &&
+                   std::equal(oldest.tokens.begin(), oldest.tokens.end(), cached.begin() + begin);
+    if (inCache && llama_memory_can_shift(mem)) {
+        const llama_pos n_discard = static_cast<llama_pos>(oldest.tokens.size());
+        llama_memory_seq_rm(mem, session.seqId, begin, end);
+        llama_memory_seq_add(mem, session.seqId, end, -1, -n_discard);
+        cached.erase(cached.begin() + begin, cached.begin() + end);
+    }
+
+    session.history.erase(session.history.begin());
+}
+
+bool LlamaCppInterface::shiftContext(Session& session, size_t nKeep) {
+    std::vector<llama_token>& cached = session.cachedTokens;
+    llama_memory_t mem = llama_get_memory(context_);
+    if (!llama_memory_can_shift(mem) || cached.size() <= nKeep + 1) {
+        return false;
+    }
+
+    // Discard half of the unpinned tokens and move the rest back
+    const size_t nLeft = cached.size() - nKeep;
+    const size_t nDiscard = nLeft / 2;
+    llama_memory_seq_rm(mem, session.seqId, nKeep, nKeep + nDiscard);
+    llama_memory_seq_add(mem, session.seqId, nKeep + nDiscard, -1, -static_cast<llama_pos>(nDiscard));
+    cached.erase(cached.begin() + nKeep, cached.begin() + nKeep + nDiscard);
+    return true;
+}
+
+void LlamaCppInterface::clearChatHistory() {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    defaultSession_.history.clear();
+    defaultSession_.systemTokens.clear();
+    defaultSession_.systemPrompt.clear();
+}
+
+int LlamaCppInterface::createSession(const std::string& systemPrompt) {
+    std::lock_guard<std::mutex> lock(sessionMutex_);
+    if (!modelLoaded_ || schedulerStop_ || !schedulerThread_.joinable()) {
+        setError("Sessions are not enabled; load the model with maxSessions > 0");
+        return -1;
+    }
+
+    // Sequence 0 belongs to the legacy chat, sessions take the remaining ones
+    const int nSeqMax = 1 + loadConfig_.maxSessions;
+    for (int seqId = 1; seqId < nSeqMax; ++seqId) {
+        if (sessions_.count(seqId) == 0 &&
+            std::find(retiredSeqIds_.begin(), retiredSeqIds_.end(), seqId) == retiredSeqIds_.end()) {
+            auto session = std::make_shared<Session>();
+            session->seqId = seqId;
+            session->systemPrompt = systemPrompt;
+            sessions_[seqId] = session;
+            return seqId;
+        }
+    }
+
+    setError("No free session slots");
+    return -1;
+}
+
+bool LlamaCppInterface::destroySession(int sessionId) {
+    {
+        std::lock_guard<std::mutex> lock(sessionMutex_);
+        auto it = sessions_.find(sessionId);
+        if (it == sessions_.end()) {
+            setError("Unknown session");
+            return false;
+        }
+        if (it->second->busy) {
+            setError("Session is busy");
+            return false;
+        }
+        // Spilling also runs under sessionMutex_, so the file is not being written
+        discardSpilledSequence(*it->second);
+        retiredSeqIds_.push_back(it->second->seqId);
+        sessions_.erase(it);
+    }
+    schedulerCv_.notify_one();
+    return true;
+}
+
+bool LlamaCppInterface::sessionGenerateAsync(int sessionId, const std::string& userInput, int maxTokens,
+                                             const TokenCallback& onToken, SessionDoneCallback onDone) {
+    std::lock_guard<std::mutex> lock(sessionMutex_);
+    auto it = sessions_.find(sessionId);
+    if (it == sessions_.end()) {
+        setError("Unknown session");
+        return false;
+    }
+    if (it->second->busy) {
+        setError("Session is busy");
+        return false;
+    }
+    if (schedulerStop_) {
+        setError("Model not loaded");
+        return false;
+    }
+
+    auto request = std::make_shared<SessionRequest>();
+    request->session = it->second;
+    request->userInput = userInput;
+    request->maxTokens = maxTokens;
+    request->onToken = onToken;
+    request->onDone = std::move(onDone);
+    it->second->busy = true;
+    activeRequests_.push_back(request);
+    schedulerCv_.notify_one();
+    return true;
+}
+
+std::string LlamaCppInterface::sessionGenerate(int sessionId, const std::string& userInput, int maxTokens,
+                                               const TokenCallback& onToken) {
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    bool finished = false;
+    std::string result;
+    std::string error;
+    auto onDone = [&](const std::string& text, const std::string& message) {
+        // Notified under the lock so the waiter cannot return and destroy doneCv first
+        std::lock_guard<std::mutex> lock(doneMutex);
+        result = text;
+        error = message;
+        finished = true;
+        doneCv.notify_one();
+    };
+    if (!sessionGenerateAsync(sessionId, userInput, maxTokens, onToken, onDone)) {
+        return "";
+    }
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCv.wait(lock, [&finished] { return finished; });
+    if (!error.empty()) {
+        setError(error);
+        return "";
+    }
+    return result;
+}
+
+void LlamaCppInterface::startScheduler() {
+    schedulerStop_ = false;
+    schedulerThread_ = std::thread(&LlamaCppInterface::schedulerLoop, this);
+}
+
+void LlamaCppInterface::stopScheduler() {
+    std::vector<std::shared_ptr<SessionRequest>> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(sessionMutex_);
+        schedulerStop_ = true;
+        abandoned.swap(activeRequests_);
+        sessions_.clear();
+        retiredSeqIds_.clear();
+    }
+    schedulerCv_.notify_all();
+    if (schedulerThread_.joinable()) {
+        schedulerThread_.join();
+    }
+    // The scheduler no longer touches these, so they can be completed from this thread
+    for (auto& request : abandoned) {
+        request->error = "Model unloaded";
+        request->done = true;
+        finishSessionRequest(*request);
+    }
+}
+
+void LlamaCppInterface::schedulerLoop() {
+    llama_batch batch = llama_batch_init(static_cast<int32_t>(llama_n_batch(context_)), 0, 1);
+
+    while (true) {
+        std::vector<std::shared_ptr<SessionRequest>> requests;
+        std::vector<llama_seq_id> retired;
+        {
+            std::unique_lock<std::mutex> lock(sessionMutex_);
+            schedulerCv_.wait(lock, [this] {
+                return schedulerStop_ || !activeRequests_.empty() || !retiredSeqIds_.empty();
+            });
+            if (schedulerStop_) {
+                break;
+            }
+            requests = activeRequests_;
+            retired.swap(retiredSeqIds_);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(contextMutex_);
+            // Destroyed sessions' cells go first; their sequence ids are free again from here on
+            for (llama_seq_id seqId : retired) {
+                if (context_) {
+                    llama_memory_seq_rm(llama_get_memory(context_), seqId, -1, -1);
+                }
+            }
+            for (const auto& request : requests) {
+                if (!request->prepared) {
+                    prepareSessionRequest(*request);
+                }
+            }
+            schedulerStep(requests, batch);
+            if (!retired.empty() || std::any_of(requests.begin(), requests.end(),
+                                                [](const std::shared_ptr<SessionRequest>& request) {
+                                                    return request->done;
+                                                })) {
+                publishSnapshot();
+            }
+        }
+
+        // Requests still queued belong to the scheduler; stopScheduler() takes over the rest
+        std::vector<std::shared_ptr<SessionRequest>> finished;
+        {
+            std::lock_guard<std::mutex> lock(sessionMutex_);
+            auto split = std::stable_partition(activeRequests_.begin(), activeRequests_.end(),
+                                               [](const std::shared_ptr<SessionRequest>& request) {
+                                                   return !request->done;
+                                               });
+            finished.assign(split, activeRequests_.end());
+            activeRequests_.erase(split, activeRequests_.end());
+        }
+        for (auto& request : finished) {
+            finishSessionRequest(*request);
+        }
+    }
+
+    llama_batch_free(batch);
+}
+
+// Requires contextMutex_. A request that cannot start ends right away with its error.
+void LlamaCppInterface::prepareSessionRequest(SessionRequest& request) {
+    request.prepared = true;
+    Session& session = *request.session;
+    if (!ensureResident() ||
+        !buildChatPrompt(session, request.userInput, request.maxTokens, request.userTokens, request.promptTokens)) {
+        request.error = getLastError();
+        request.done = true;
+        return;
+    }
+    // Session requests take no cancel or deadlines; only an unload stops the prefix prefill, and
+    // stopScheduler() then completes the request
+    if (!primeSystemPrefix(session) && schedulerStop_) {
+        return;
+    }
+    request.nPrefilled = reuseCachedPrefix(session, request.promptTokens);
+    request.sampler = prepareSampler(session, request.promptTokens);
+    session.detokenizer.reset(llama_model_get_vocab(model_));
+    session.stopMatcher.setStops(chatStopStrings(session.samplerConfig), session.samplerConfig.stopTokens);
+}
+
+// Called without locks once the request has left the queue. The session stays busy until the turn is in its
+// history: memory pressure must not spill or drop its KV state before that.
+void LlamaCppInterface::finishSessionRequest(SessionRequest& request) {
+    Session& session = *request.session;
+    if (request.error.empty()) {
+        const std::string& tail = session.stopMatcher.finish(session.detokenizer.flush());
+        if (!tail.empty()) {
+            request.result += tail;
+            if (request.onToken) {
+                request.onToken(tail);
+            }
+        }
+        if (!request.result.empty()) {
+            std::lock_guard<std::mutex> lock(contextMutex_);
+            appendChatTurn(session, request.userInput, request.result, request.userTokens, request.generated);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(sessionMutex_);
+        session.busy = false;
+    }
+    if (request.onDone) {
+        request.onDone(request.result, request.error);
+    }
+}
+
+void LlamaCppInterface::schedulerStep(const std::vector<std::shared_ptr<SessionRequest>>& requests,
+                                      llama_batch& batch) {
+    const llama_vocab* vocab = llama_model_get_vocab(model_);
+    const int32_t nBatch = static_cast<int32_t>(llama_n_batch(context_));
+    batch.n_tokens = 0;
+
+    // Decoding sessions go first: one token each keeps their latency flat
+    for (const auto& request : requests) {
+        request->iBatch = -1;
+        request->nBatched = 0;
+        if (!request->done && request->nPrefilled == request->promptTokens.size() && batch.n_tokens < nBatch) {
+            Session& session = *request->session;
+            batchAdd(batch, request->lastToken, session.cachedTokens.size(), session.seqId, true);
+            request->iBatch = batch.n_tokens - 1;
+            request->nBatched = 1;
+        }
+    }
+
+    // Prompt chunks of newly joined sessions fill the rest of the batch
+    for (const auto& request : requests) {
+        if (request->done || request->nPrefilled == request->promptTokens.size()) {
+            continue;
+        }
+        Session& session = *request->session;
+        while (request->nPrefilled + request->nBatched < request->promptTokens.size() && batch.n_tokens < nBatch) {
+            size_t idx = request->nPrefilled + request->nBatched;
+            bool last = idx + 1 == request->promptTokens.size();
+            batchAdd(batch, request->promptTokens[idx], idx, session.seqId, last);
+            request->nBatched++;
+            if (last) {
+                request->iBatch = batch.n_tokens - 1;
+            }
+        }
+    }
+
+    if (batch.n_tokens == 0) {
+        return;
+    }
+
+    if (llama_decode(context_, batch) != 0) {
+        for (const auto& request : requests) {
+            if (request->nBatched > 0) {
+                Session& session = *request->session;
+                llama_memory_seq_rm(llama_get_memory(context_), session.seqId, session.cachedTokens.size(), -1);
+                request->error = "Failed to decode batch";
+                request->done = true;
+            }
+        }
+        return;
+    }
+
+    for (const auto& request : requests) {
+        if (request->nBatched == 0) {
+            continue;
+        }
+        Session& session = *request->session;
+        if (request->nPrefilled < request->promptTokens.size()) {
+            auto begin = request->promptTokens.begin() + request->nPrefilled;
+            session.cachedTokens.insert(session.cachedTokens.end(), begin, begin + request->nBatched);
+            request->nPrefilled += request->nBatched;
+        } else {
+            session.cachedTokens.push_back(request->lastToken);
+        }
+
+        if (request->iBatch < 0) {
+            continue;
+        }
+
+        llama_token token = llama_sampler_sample(request->sampler, context_, request->iBatch);
+        if (llama_vocab_is_eog(vocab, token) || session.stopMatcher.isStopToken(token)) {
+            request->done = true;
+            continue;
+        }
+        request->generated.push_back(token);
+        request->lastToken = token;
+
+        const std::string& piece = session.stopMatcher.push(session.detokenizer.push(token));
+        if (!piece.empty()) {
+            request->result += piece;
+            if (request->onToken && !request->onToken(piece)) {
+                request->done = true;
+            }
+        }
+        if (session.stopMatcher.matched()) {
+            request->done = true;
+        }
+        if (static_cast<int>(request->generated.size()) >= request->maxTokens) {
+            request->done = true;
+        }
+    }
+}
+
+bool LlamaCppInterface::enablePrefixCache(const std::string& directory, size_t maxBytes) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    if (directory.empty()) {
+        prefixCache_.reset();
+        publishSnapshot();
+        return true;
+    }
+    auto cache = std::make_unique<PrefixCache>(directory, maxBytes);
+    if (access(directory.c_str(), W_OK) != 0) {
+        setError("Prefix cache directory is not writable: " + directory);
+        return false;
+    }
+    prefixCache_ = std::move(cache);
+    publishSnapshot();
+    return true;
 }
 
-bool LlamaCppInterface::loadModel(const std::string& modelPath, int contextSize, int threads) {
+bool LlamaCppInterface::enableModelPool(size_t maxBytes) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    if (modelPool_) {
+        modelPool_->setMaxBytes(maxBytes);
+        publishSnapshot();
+        return true;
+    }
     if (modelLoaded_) {
-        unloadModel();
+        setError("Enable the model pool before loading a model");
+        return false;
     }
+    modelPool_ = std::make_unique<ModelPool>(maxBytes);
+    publishSnapshot();
+    return true;
+}
 
-    // Set up model parameters
-    llama_model_params model_params = llama_model_default_params();
-    
-    // Load the model
-    model_ = llama_model_load_from_file(modelPath.c_str(), model_params);
-    if (!model_) {
-        setError("Failed to load model from: " + modelPath);
+bool LlamaCppInterface::preloadModel(const std::string& modelPath, const LoadConfig& config) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    if (!modelPool_) {
+        setError("Model pool is not enabled");
+        return false;
+    }
+    beginLoad();
+    llama_model* model = acquireModel(modelPath, modelParams(config));
+    loadProgress_ = nullptr;
+    const bool cancelled = endLoad();
+    if (!model) {
+        setError(cancelled ? "Model load cancelled" : "Failed to load model from: " + modelPath);
+        return false;
+    }
+    modelPool_->release(model);
+    publishSnapshot();
+    if (cancelled) {
+        setError("Model load cancelled");
         return false;
     }
+    return true;
+}
 
-    // Set up context parameters
-    llama_context_params ctx_params = llama_context_default_params();
-    ctx_params.n_ctx = contextSize;
-    ctx_params.n_threads = threads;
-    ctx_params.n_threads_batch = threads;
-    ctx_params.n_batch = contextSize;
+ModelPool::Stats LlamaCppInterface::getModelPoolStats() const {
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    return snapshot_.modelPoolStats;
+}
 
-    // Create context
-    context_ = llama_init_from_model(model_, ctx_params);
-    if (!context_) {
-        setError("Failed to create context");
-        llama_model_free(model_);
-        model_ = nullptr;
+PrefixCache::Stats LlamaCppInterface::getPrefixCacheStats() const {
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    return snapshot_.prefixCacheStats;
+}
+
+bool LlamaCppInterface::loadLoraAdapter(const std::string& name, const std::string& path) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    if (!ensureResident()) {
+        return false;
+    }
+    if (loraAdapters_.count(name) > 0) {
+        setError("LoRA adapter already loaded: " + name);
         return false;
     }
 
-    modelLoaded_ = true;
-    chatHistory_.clear();
-    lastError_.clear();
+    LoraAdapter lora;
+    lora.path = path;
+    lora.fileId = fileIdentity(path);
+    lora.adapter = llama_adapter_lora_init(model_, path.c_str());
+    if (!lora.adapter) {
+        setError("Failed to load LoRA adapter from: " + path);
+        return false;
+    }
+    loraAdapters_[name] = lora;
+    publishSnapshot();
     return true;
 }
 
-void LlamaCppInterface::unloadModel() {
-    if (context_) {
-        llama_free(context_);
-        context_ = nullptr;
+bool LlamaCppInterface::setLoraAdapter(const std::string& name, float scale) {
+    std::scoped_lock lock(sessionMutex_, contextMutex_);
+    auto it = loraAdapters_.find(name);
+    if (it == loraAdapters_.end()) {
+        setError("Unknown LoRA adapter: " + name);
+        return false;
     }
-    if (model_) {
-        llama_model_free(model_);
-        model_ = nullptr;
+    if (it->second.scale == scale) {
+        return true;
     }
-    modelLoaded_ = false;
-    chatHistory_.clear();
+    if (!loraChangeAllowed()) {
+        return false;
+    }
+    it->second.scale = scale;
+    applyLoraAdapters();
+    publishSnapshot();
+    return true;
 }
 
-bool LlamaCppInterface::isModelLoaded() const {
-    return modelLoaded_;
+bool LlamaCppInterface::removeLoraAdapter(const std::string& name) {
+    return setLoraAdapter(name, 0.0f);
+}
+
+bool LlamaCppInterface::clearLoraAdapters() {
+    std::scoped_lock lock(sessionMutex_, contextMutex_);
+    auto active = [](const std::pair<const std::string, LoraAdapter>& entry) { return entry.second.scale != 0.0f; };
+    if (std::none_of(loraAdapters_.begin(), loraAdapters_.end(), active)) {
+        return true;
+    }
+    if (!loraChangeAllowed()) {
+        return false;
+    }
+    for (auto& entry : loraAdapters_) {
+        entry.second.scale = 0.0f;
+    }
+    applyLoraAdapters();
+    publishSnapshot();
+    return true;
+}
+
+bool LlamaCppInterface::unloadLoraAdapter(const std::string& name) {
+    std::scoped_lock lock(sessionMutex_, contextMutex_);
+    auto it = loraAdapters_.find(name);
+    if (it == loraAdapters_.end()) {
+        setError("Unknown LoRA adapter: " + name);
+        return false;
+    }
+    if (it->second.scale != 0.0f) {
+        if (!loraChangeAllowed()) {
+            return false;
+        }
+        it->second.scale = 0.0f;
+        applyLoraAdapters();
+    }
+    if (it->second.adapter) {
+        llama_adapter_lora_free(it->second.adapter);
+    }
+    loraAdapters_.erase(it);
+    publishSnapshot();
+    return true;
+}
+
+std::vector<LlamaCppInterface::LoraAdapterInfo> LlamaCppInterface::getLoraAdapters() const {
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    return snapshot_.loraAdapters;
 }
 
-std::string LlamaCppInterface::generateText(const std::string& prompt, int maxTokens, float temperature, float topP) {
+// Requires sessionMutex_ and contextMutex_: a session request in flight would continue on KV entries
+// computed with other weights
+bool LlamaCppInterface::loraChangeAllowed() {
     if (!modelLoaded_) {
         setError("Model not loaded");
-        return "";
+        return false;
+    }
+    for (const auto& entry : sessions_) {
+        if (entry.second->busy) {
+            setError("LoRA adapters cannot change while session requests are running");
+            return false;
+        }
     }
+    return true;
+}
 
-    const llama_vocab* vocab = llama_model_get_vocab(model_);
-    
-    // Initialize sampler
-    llama_sampler* sampler = llama_sampler_chain_init(llama_sampler_chain_default_params());
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_p(topP, 1));
-    llama_sampler_chain_add(sampler, llama_sampler_init_temp(temperature));
-    llama_sampler_chain_add(sampler, llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
+void LlamaCppInterface::attachLoraAdapters(llama_context* context) const {
+    llama_clear_adapter_lora(context);
+    for (const auto& entry : loraAdapters_) {
+        if (entry.second.scale != 0.0f) {
+            llama_set_adapter_lora(context, entry.second.adapter, entry.second.scale);
+        }
+    }
+}
 
-    // Tokenize the prompt
-    std::vector<int> tokens = tokenize(prompt);
-    if (tokens.empty()) {
-        setError("Failed to tokenize prompt");
-        llama_sampler_free(sampler);
-        return "";
+// Requires sessionMutex_ and contextMutex_
+void LlamaCppInterface::applyLoraAdapters() {
+    for (llama_context* context : {context_, batchContext_, embedContext_}) {
+        if (context) {
+            attachLoraAdapters(context);
+        }
     }
 
-    // Convert to llama_token
-    std::vector<llama_token> llama_tokens;
-    for (int token : tokens) {
-        llama_tokens.push_back(static_cast<llama_token>(token));
+    // Cached keys and values no longer match the weights; every conversation re-prefills its transcript
+    if (context_) {
+        llama_memory_clear(llama_get_memory(context_), true);
+    }
+    defaultSession_.cachedTokens.clear();
+    discardSpilledSequence(defaultSession_);
+    for (auto& entry : sessions_) {
+        entry.second->cachedTokens.clear();
+        discardSpilledSequence(*entry.second);
     }
+}
 
-    // Process the prompt tokens
-    llama_batch batch = llama_batch_get_one(llama_tokens.data(), llama_tokens.size());
-    if (llama_decode(context_, batch) != 0) {
-        setError("Failed to process prompt tokens");
-        llama_sampler_free(sampler);
-        return "";
+void LlamaCppInterface::freeLoraAdapters() {
+    for (auto& entry : loraAdapters_) {
+        if (entry.second.adapter) {
+            llama_adapter_lora_free(entry.second.adapter);
+        }
     }
+    loraAdapters_.clear();
+}
 
-    // Generate tokens
-    std::string result;
-    for (int i = 0; i < maxTokens; ++i) {
-        llama_token new_token_id = llama_sampler_sample(sampler, context_, -1);
-        
-        if (llama_vocab_is_eog(vocab, new_token_id)) {
-            break;
+std::string LlamaCppInterface::weightsId() const {
+    // Attached adapters in a name-independent order, so renaming one keeps its cached prefixes
+    std::vector<std::string> adapters;
+    for (const auto& entry : loraAdapters_) {
+        const LoraAdapter& lora = entry.second;
+        if (lora.scale != 0.0f) {
+            adapters.push_back((lora.fileId.empty() ? lora.path : lora.fileId) + "@" + std::to_string(lora.scale));
         }
+    }
+    std::sort(adapters.begin(), adapters.end());
+    std::string id = modelId_;
+    for (const std::string& adapter : adapters) {
+        id += "|lora:" + adapter;
+    }
+    return id;
+}
+
+LlamaCppInterface::MemoryPressure LlamaCppInterface::handleMemoryPressure(MemoryPressure level) {
+    std::scoped_lock lock(sessionMutex_, contextMutex_);
+    const MemoryPressure applied = releaseMemory(level);
+    publishSnapshot();
+    return applied;
+}
+
+// Requires sessionMutex_ and contextMutex_
+LlamaCppInterface::MemoryPressure LlamaCppInterface::releaseMemory(MemoryPressure level) {
+    if (level == MemoryPressure::None) {
+        return MemoryPressure::None;
+    }
 
-        // Convert token to text
-        char buf[256];
-        int n = llama_token_to_piece(vocab, new_token_id, buf, sizeof(buf), 0, true);
-        if (n > 0) {
-            result += std::string(buf, n);
+    // Moderate: contexts created on demand anyway, and models nobody uses
+    if (batchContext_) {
+        llama_free(batchContext_);
+        batchContext_ = nullptr;
+    }
+    if (embedContext_) {
+        llama_free(embedContext_);
+        embedContext_ = nullptr;
+    }
+    if (modelPool_) {
+        modelPool_->evictIdle();
+    }
+    if (level == MemoryPressure::Moderate || !modelLoaded_) {
+        return MemoryPressure::Moderate;
+    }
+    // A running session request decodes on context_ without holding contextMutex_ between steps
+    for (const auto& entry : sessions_) {
+        if (entry.second->busy) {
+            return MemoryPressure::Moderate;
         }
+    }
 
-        // Prepare the next token for decoding
-        llama_batch next_batch = llama_batch_get_one(&new_token_id, 1);
-        if (llama_decode(context_, next_batch) != 0) {
-            setError("Failed to decode token");
-            break;
+    // Low: the KV cache and compute buffers of the inference contexts
+    if (context_) {
+        spillSequence(defaultSession_);
+        for (auto& entry : sessions_) {
+            spillSequence(*entry.second);
         }
+        llama_free(context_);
+        context_ = nullptr;
+    }
+    if (draftSampler_) {
+        llama_sampler_free(draftSampler_);
+        draftSampler_ = nullptr;
+    }
+    if (draftContext_) {
+        llama_free(draftContext_);
+        draftContext_ = nullptr;
+    }
+    draftCachedTokens_.clear();
+    if (level == MemoryPressure::Low) {
+        return MemoryPressure::Low;
     }
 
-    llama_sampler_free(sampler);
-    return result;
+    // Critical: the weights. Adapters keep their path and scale so they can be loaded again.
+    for (auto& entry : loraAdapters_) {
+        if (entry.second.adapter) {
+            llama_adapter_lora_free(entry.second.adapter);
+            entry.second.adapter = nullptr;
+        }
+    }
+    if (draftModel_) {
+        releaseModel(draftModel_);
+        draftModel_ = nullptr;
+    }
+    if (model_) {
+        releaseModel(model_);
+        model_ = nullptr;
+    }
+    if (modelPool_) {
+        modelPool_->evictIdle();
+    }
+    return MemoryPressure::Critical;
 }
 
-std::string LlamaCppInterface::chatCompletion(const std::string& userInput, const std::string& systemPrompt) {
+// Rebuilds what handleMemoryPressure released; requires contextMutex_. Conversations load their
+// spilled KV state when they are next used.
+bool LlamaCppInterface::ensureResident() {
     if (!modelLoaded_) {
         setError("Model not loaded");
-        return "";
+        return false;
+    }
+    if (context_) {
+        return true;
     }
 
-    // Build chat prompt
-    std::ostringstream prompt;
-    
-    if (!systemPrompt.empty()) {
-        prompt << "System: " << systemPrompt << "\n\n";
+    if (!model_) {
+        model_ = acquireModel(modelPath_, modelParams(loadConfig_));
+        loadProgress_ = nullptr;
+        if (!model_) {
+            setError("Failed to reload model from: " + modelPath_);
+            return false;
+        }
     }
-    
-    // Add chat history
-    for (const auto& entry : chatHistory_) {
-        prompt << entry << "\n";
+    for (auto& entry : loraAdapters_) {
+        if (!entry.second.adapter) {
+            entry.second.adapter = llama_adapter_lora_init(model_, entry.second.path.c_str());
+            if (!entry.second.adapter) {
+                setError("Failed to reload LoRA adapter from: " + entry.second.path);
+                return false;
+            }
+        }
     }
-    
-    prompt << "User: " << userInput << "\nAssistant: ";
-    
-    // Generate response
-    std::string response = generateText(prompt.str(), 150, 0.8f, 0.95f);
-    
-    if (!response.empty()) {
-        // Add to chat history
-        chatHistory_.push_back("User: " + userInput);
-        chatHistory_.push_back("Assistant: " + response);
-        
-        // Keep history manageable (last 10 exchanges)
-        if (chatHistory_.size() > 20) {
-            chatHistory_.erase(chatHistory_.begin(), chatHistory_.begin() + 2);
+    if (!createContext(loadConfig_)) {
+        return false;
+    }
+
+    // Without its draft the target still decodes on its own, so a failure here is not fatal
+    if (!loadConfig_.draftModelPath.empty()) {
+        if (!draftModel_) {
+            loadDraftModel(loadConfig_);
+        } else if (!draftContext_) {
+            createDraftContext(loadConfig_);
         }
     }
-    
-    return response;
+    publishSnapshot();
+    return true;
 }
 
-void LlamaCppInterface::clearChatHistory() {
-    chatHistory_.clear();
+std::string LlamaCppInterface::spillPath(llama_seq_id seqId) const {
+    return loadConfig_.spillDirectory + "/llama-seq-" + std::to_string(seqId) + ".state";
+}
+
+void LlamaCppInterface::spillSequence(Session& session) {
+    std::vector<llama_token>& cached = session.cachedTokens;
+    if (!cached.empty() && !loadConfig_.spillDirectory.empty()) {
+        const std::string path = spillPath(session.seqId);
+        if (llama_state_seq_save_file(context_, path.c_str(), session.seqId, cached.data(), cached.size()) > 0) {
+            session.spillFile = path;
+        }
+    }
+    cached.clear();
+}
+
+void LlamaCppInterface::restoreSpilledSequence(Session& session) {
+    if (session.spillFile.empty()) {
+        return;
+    }
+    llama_memory_t mem = llama_get_memory(context_);
+    llama_memory_seq_rm(mem, session.seqId, -1, -1);
+    std::vector<llama_token> tokens(llama_n_ctx(context_));
+    size_t nTokens = 0;
+    if (llama_state_seq_load_file(context_, session.spillFile.c_str(), session.seqId, tokens.data(), tokens.size(),
+                                  &nTokens) > 0) {
+        tokens.resize(nTokens);
+        session.cachedTokens = tokens;
+    } else {
+        // Unreadable state: start the sequence over, the transcript is prefilled again
+        llama_memory_seq_rm(mem, session.seqId, -1, -1);
+        session.cachedTokens.clear();
+    }
+    discardSpilledSequence(session);
+}
+
+void LlamaCppInterface::discardSpilledSequence(Session& session) {
+    if (!session.spillFile.empty()) {
+        std::remove(session.spillFile.c_str());
+        session.spillFile.clear();
+    }
+}
+
+LlamaCppInterface::PerfStats LlamaCppInterface::getPerfStats() const {
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    return snapshot_.perfStats;
+}
+
+LlamaCppInterface::SpeculativeStats LlamaCppInterface::getSpeculativeStats() const {
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    return snapshot_.speculativeStats;
+}
+
+// Requires contextMutex_. Called after every change the getters can observe: loads, finished
+// requests, adapter and cache configuration, memory pressure.
+void LlamaCppInterface::publishSnapshot() {
+    Snapshot snapshot;
+    snapshot.perfStats = perfStats_;
+    if (context_) {
+        PerfStats& stats = snapshot.perfStats;
+        llama_memory_t mem = llama_get_memory(context_);
+        const llama_seq_id nSeqMax = static_cast<llama_seq_id>(llama_n_seq_max(context_));
+        for (llama_seq_id seqId = 0; seqId < nSeqMax; ++seqId) {
+            const llama_pos posMax = llama_memory_seq_pos_max(mem, seqId);
+            if (posMax >= 0) {
+                stats.kvUsed += posMax - llama_memory_seq_pos_min(mem, seqId) + 1;
+            }
+        }
+        stats.kvSize = llama_n_ctx(context_);
+        stats.kvBytes = kvCacheBytes_;
+    }
+    snapshot.speculativeStats = speculativeStats_;
+    for (const auto& entry : loraAdapters_) {
+        LoraAdapterInfo info;
+        info.name = entry.first;
+        info.path = entry.second.path;
+        info.scale = entry.second.scale;
+        snapshot.loraAdapters.push_back(info);
+    }
+    snapshot.modelPoolStats = modelPool_ ? modelPool_->getStats() : ModelPool::Stats();
+    snapshot.prefixCacheStats = prefixCache_ ? prefixCache_->getStats() : PrefixCache::Stats();
+    snapshot.modelInfo = describeModel();
+
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    snapshot_ = std::move(snapshot);
+}
+
+void LlamaCppInterface::setPrefillProgressCallback(const ProgressCallback& onProgress) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    prefillProgress_ = onProgress;
+}
+
+void LlamaCppInterface::getPrefillProgress(size_t& processed, size_t& total) const {
+    processed = prefillProcessed_;
+    total = prefillTotal_;
+}
+
+bool LlamaCppInterface::cancelLoad() {
+    // A cancel with no load in progress must not stop the next one
+    if (!loadInProgress_) {
+        return false;
+    }
+    loadCancelRequested_ = true;
+    return true;
+}
+
+// Opens the window in which cancelLoad() applies, clearing a cancel left from an earlier load
+void LlamaCppInterface::beginLoad() {
+    loadCancelRequested_ = false;
+    loadInProgress_ = true;
+}
+
+// Closes the window; returns whether the load was cancelled in it
+bool LlamaCppInterface::endLoad() {
+    loadInProgress_ = false;
+    return loadCancelRequested_.exchange(false);
+}
+
+void LlamaCppInterface::requestAbort() {
+    abortRequested_ = true;
+}
+
+void LlamaCppInterface::clearAbort() {
+    abortRequested_ = false;
+}
+
+bool LlamaCppInterface::wasCancelled() const {
+    return lastCancelled_;
+}
+
+bool LlamaCppInterface::abortCallback(void* data) {
+    auto* self = static_cast<LlamaCppInterface*>(data);
+    return self->abortArmed_ && (self->abortRequested_.load() || self->deadlineExpired());
+}
+
+void LlamaCppInterface::setDeadlines(const Deadlines& deadlines) {
+    std::lock_guard<std::mutex> lock(contextMutex_);
+    deadlines_ = deadlines;
+}
+
+LlamaCppInterface::FinishReason LlamaCppInterface::getLastFinishReason() const {
+    return lastFinishReason_;
+}
+
+// Arms cancellation and the request's deadlines, starting with the prefill phase
+void LlamaCppInterface::armRequest() {
+    abortArmed_ = true;
+    totalDeadline_ = deadlines_.totalMs > 0
+                         ? Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                              std::chrono::duration<double, std::milli>(deadlines_.totalMs))
+                         : Clock::time_point::max();
+    armDeadline(FinishReason::PrefillDeadline);
+}
+
+void LlamaCppInterface::disarmRequest() {
+    abortDeadline_ = INT64_MAX;
+    abortRequested_ = false;
+    abortArmed_ = false;
+}
+
+void LlamaCppInterface::armDeadline(FinishReason phase) {
+    // The earlier of the request's total deadline and the one for the current phase
+    const double phaseMs = phase == FinishReason::PrefillDeadline ? deadlines_.prefillMs : deadlines_.tokenGapMs;
+    Clock::time_point deadline = Clock::time_point::max();
+    if (phaseMs > 0) {
+        deadline = Clock::now() +
+                   std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(phaseMs));
+    }
+    deadlineReason_ = phase;
+    if (totalDeadline_ <= deadline) {
+        deadline = totalDeadline_;
+        deadlineReason_ = FinishReason::TotalDeadline;
+    }
+    abortDeadline_ = deadline == Clock::time_point::max() ? INT64_MAX : deadline.time_since_epoch().count();
+}
+
+bool LlamaCppInterface::deadlineExpired() const {
+    return Clock::now().time_since_epoch().count() >= abortDeadline_.load();
+}
+
+bool LlamaCppInterface::recordInterruption() {
+    if (abortRequested_) {
+        lastCancelled_ = true;
+        lastFinishReason_ = FinishReason::Cancelled;
+        setError("Generation cancelled");
+        return true;
+    }
+    if (deadlineExpired()) {
+        // Not an error: the request ends early and keeps what it generated
+        lastFinishReason_ = deadlineReason_;
+        return true;
+    }
+    return false;
 }
 
 std::string LlamaCppInterface::getModelInfo() const {
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    return snapshot_.modelInfo;
+}
+
+// Requires contextMutex_
+std::string LlamaCppInterface::describeModel() const {
     if (!modelLoaded_) {
         return "No model loaded";
     }
+    if (!context_) {
+        return model_ ? "Model loaded; context released under memory pressure"
+                      : "Model released under memory pressure";
+    }
     
     const llama_vocab* vocab = llama_model_get_vocab(model_);
     
     std::ostringstream info;
     info << "Model loaded: " << (model_ ? "Yes" : "No") << "\n";
     info << "Context size: " << llama_n_ctx(context_) << "\n";
+    info << "Batch size: " << llama_n_batch(context_) << " (ubatch " << llama_n_ubatch(context_) << ")\n";
     info << "Vocabulary size: " << llama_vocab_n_tokens(vocab) << "\n";
+    info << "Cached tokens: " << defaultSession_.cachedTokens.size() << "\n";
+    info << "Session slots: " << llama_n_seq_max(context_) - 1 << "\n";
+    if (draftModel_) {
+        info << "Draft tokens: " << draftTokens_ << "\n";
+    }
+    info << "KV cache: " << llama_n_ctx(context_) << " cells, " << ggml_type_name(loadConfig_.kvCacheTypeK) << "/"
+         << ggml_type_name(loadConfig_.kvCacheTypeV) << ", " << (kvCacheBytes_ >> 20) << " MiB\n";
+    if (!loraAdapters_.empty()) {
+        info << "LoRA adapters:";
+        for (const auto& entry : loraAdapters_) {
+            info << " " << entry.first << "@" << entry.second.scale;
+        }
+        info << "\n";
+    }
+    info << "Threads: prefill " << prefillThreads_ << ", decode " << decodeThreads_ << "\n";
+    info << "CPU cores: " << cpuTopology_.cpus().size() << " (" << cpuTopology_.performanceCpus().size()
+         << " performance)\n";
     
     return info.str();
 }
 
 std::string LlamaCppInterface::getLastError() const {
+    std::lock_guard<std::mutex> lock(errorMutex_);
     return lastError_;
 }
 
+size_t LlamaCppInterface::sequenceBudget() const {
+    return llama_n_ctx(context_) / llama_n_seq_max(context_);
+}
+
+size_t LlamaCppInterface::reuseCachedPrefix(Session& session, const std::vector<llama_token>& tokens) {
+    restoreSpilledSequence(session);
+    std::vector<llama_token>& cached = session.cachedTokens;
+    size_t n_past = 0;
+    while (n_past < cached.size() && n_past < tokens.size() && cached[n_past] == tokens[n_past]) {
+        ++n_past;
+    }
+    
+    // Always re-evaluate at least the last prompt token so there are logits to sample from
+    if (n_past == tokens.size() && n_past > 0) {
+        --n_past;
+    }
+    
+    // Drop the diverging tail from the KV cache and keep the shared prefix
+    llama_memory_seq_rm(llama_get_memory(context_), session.seqId, n_past, -1);
+    cached.resize(n_past);
+    return n_past;
+}
+
 void LlamaCppInterface::setError(const std::string& error) {
+    std::lock_guard<std::mutex> lock(errorMutex_);
     lastError_ = error;
     std::cerr << "LlamaCpp Error: " << error << std::endl;
 }
 
-std::vector<int> LlamaCppInterface::tokenize(const std::string& text) const {
+std::vector<std::string> LlamaCppInterface::chatStopStrings(const SamplerConfig& config) const {
+    // Without a template the model has no end-of-turn token and tends to write the next user turn
+    std::vector<std::string> stops = config.stopStrings;
+    if (chatTemplate_.empty()) {
+        stops.push_back("\nUser:");
+    }
+    return stops;
+}
+
+std::vector<llama_chat_message> LlamaCppInterface::chatMessages(const Session& session) const {
+    std::vector<llama_chat_message> messages;
+    messages.reserve(1 + 2 * session.history.size());
+    if (!session.systemPrompt.empty()) {
+        messages.push_back({"system", session.systemPrompt.c_str()});
+    }
+    for (const ChatTurn& turn : session.history) {
+        messages.push_back({"user", turn.userInput.c_str()});
+        messages.push_back({"assistant", turn.response.c_str()});
+    }
+    return messages;
+}
+
+std::string LlamaCppInterface::transcriptText(const Session& session) const {
+    std::string text = session.systemText;
+    for (const ChatTurn& turn : session.history) {
+        text += turn.text;
+    }
+    return text;
+}
+
+std::string LlamaCppInterface::renderChat(const std::vector<llama_chat_message>& messages, bool addAssistant) const {
+    if (chatTemplate_.empty()) {
+        // Plain format for models without a recognized template
+        std::string text;
+        for (const llama_chat_message& message : messages) {
+            const std::string role = message.role;
+            if (role == "system") {
+                text += std::string("System: ") + message.content + "\n\n";
+            } else if (role == "user") {
+                text += std::string("User: ") + message.content + "\n";
+            } else {
+                text += std::string("Assistant: ") + message.content + "\n";
+            }
+        }
+        return addAssistant ? text + "Assistant: " : text;
+    }
+
+    // The result is the full rendered length, so a second call with a buffer that large always fits
+    std::string text(256, '\0');
+    int32_t n = llama_chat_apply_template(chatTemplate_.c_str(), messages.data(), messages.size(), addAssistant,
+                                          &text[0], static_cast<int32_t>(text.size()));
+    if (n > static_cast<int32_t>(text.size())) {
+        text.resize(n);
+        n = llama_chat_apply_template(chatTemplate_.c_str(), messages.data(), messages.size(), addAssistant,
+                                      &text[0], static_cast<int32_t>(text.size()));
+    }
+    text.resize(std::max(0, n));
+    return text;
+}
+
+size_t LlamaCppInterface::commonPrefixLength(const std::string& a, const std::string& b) {
+    const size_t n = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) {
+        ++i;
+    }
+    return i;
+}
+
+std::vector<llama_token> LlamaCppInterface::tokenize(const std::string& text, bool addSpecial) const {
     if (!model_) {
         return {};
     }
     
     const llama_vocab* vocab = llama_model_get_vocab(model_);
-    const bool is_first = true; // Assume this is first tokenization for simplicity
     
-    int n_tokens = -llama_tokenize(vocab, text.c_str(), text.length(), NULL, 0, is_first, true);
+    int n_tokens = -llama_tokenize(vocab, text.c_str(), text.length(), NULL, 0, addSpecial, true);
     if (n_tokens <= 0) {
         return {};
     }
     
     std::vector<llama_token> tokens(n_tokens);
     int actual_tokens = llama_tokenize(vocab, text.c_str(), text.length(), 
-                                       tokens.data(), n_tokens, is_first, true);
+                                       tokens.data(), n_tokens, addSpecial, true);
     
     if (actual_tokens < 0) {
         return {};
     }
     
-    std::vector<int> result;
-    result.reserve(actual_tokens);
-    
-    for (int i = 0; i < actual_tokens; ++i) {
-        result.push_back(static_cast<int>(tokens[i]));
-    }
-    
-    return result;
+    tokens.resize(actual_tokens);
+    return tokens;
 }
 
-std::string LlamaCppInterface::detokenize(const std::vector<int>& tokens) const {
+std::string LlamaCppInterface::detokenize(const std::vector<llama_token>& tokens) const {
     if (!model_ || tokens.empty()) {
         return "";
     }
     
-    const llama_vocab* vocab = llama_model_get_vocab(model_);
-    std::string result;
-    
-    for (int token : tokens) {
-        char buf[256];
-        int n = llama_token_to_piece(vocab, static_cast<llama_token>(token), buf, sizeof(buf), 0, true);
-        if (n > 0) {
-            result += std::string(buf, n);
-        }
-    }
-    
-    return result;
+    return Detokenizer::toText(llama_model_get_vocab(model_), tokens);
 }
\ No newline at end of file
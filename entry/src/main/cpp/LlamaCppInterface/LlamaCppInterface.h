@@ -1,44 +1,462 @@
 #ifndef LLAMA_CPP_INTERFACE_H
 #define LLAMA_CPP_INTERFACE_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
+#include <map>
 #include <memory>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <condition_variable>
+#include <thread>
 
-struct llama_model;
-struct llama_context;
+#include "llama.h"
+#include "ggml-cpu.h"
+#include "CpuTopology.h"
+#include "Detokenizer.h"
+#include "ModelPool.h"
+#include "PrefixCache.h"
+#include "StopMatcher.h"
 
 class LlamaCppInterface {
 public:
+    // Receives each decoded piece as soon as it is sampled; return false to stop generation
+    using TokenCallback = std::function<bool(const std::string& piece)>;
+    // Reports prompt tokens decoded so far out of the tokens that needed prefilling
+    using ProgressCallback = std::function<void(size_t processed, size_t total)>;
+    // Receives model load progress in [0, 1] from the loader thread; return false to cancel the load
+    using LoadProgressCallback = std::function<bool(float progress)>;
+    // Receives a finished session turn on the scheduler thread; error is empty on success
+    using SessionDoneCallback = std::function<void(const std::string& result, const std::string& error)>;
+    
     LlamaCppInterface();
     ~LlamaCppInterface();
     
+    struct LoadConfig {
+        int contextSize = 2048;
+        int threads = 4;
+        // Extra KV sequences for createSession(); all sequences share one unified KV cache of
+        // contextSize cells, each bounded to contextSize / (maxSessions + 1)
+        int maxSessions = 0;
+        // Prompt tokens per llama_decode, and the compute buffer size they are split into
+        int batchSize = 512;
+        int ubatchSize = 512;
+        // Optional small model with the same vocabulary, used for speculative decoding
+        std::string draftModelPath;
+        int draftTokens = 8;
+        // mmap keeps weights in the page cache and loads lazily; mlock pins them in RAM;
+        // checkTensors validates tensor data while loading at the cost of a slower load
+        bool useMmap = true;
+        bool useMlock = false;
+        bool checkTensors = false;
+        // Threads for prompt prefill and for token-by-token decode; 0 uses threads. Decode is
+        // memory-bound and rarely gains from more threads than there are performance cores.
+        int prefillThreads = 0;
+        int decodeThreads = 0;
+        // Pin both threadpools to the performance cores found in /sys/devices/system/cpu; a pool with
+        // more threads than performance cores spreads over all cores
+        bool pinThreads = true;
+        // Worker priority, and how long idle workers spin before sleeping (0 sleeps at once, 100 spins)
+        enum ggml_sched_priority threadPriority = GGML_SCHED_PRIO_NORMAL;
+        uint32_t pollLevel = 50;
+        // KV cache element types: F16, Q8_0 (about half the memory) or Q4_0 (about a quarter). A quantized
+        // V cache needs flash attention, so it cannot be combined with flashAttention disabled.
+        enum ggml_type kvCacheTypeK = GGML_TYPE_F16;
+        enum ggml_type kvCacheTypeV = GGML_TYPE_F16;
+        enum llama_flash_attn_type flashAttention = LLAMA_FLASH_ATTN_TYPE_AUTO;
+        // Keep the KV cache and attention on the accelerator backend, if there is one
+        bool offloadKv = true;
+        // Fragmentation ratio past which llama.cpp defragments the KV cache; <= 0 disables
+        float defragThreshold = 0.0f;
+        // Memory pressure saves each conversation's KV state here (one directory per instance);
+        // without one the state is dropped and re-prefilled from the chat history
+        std::string spillDirectory;
+        LoadProgressCallback onProgress;
+    };
+    
+    // Sampling parameters of one conversation. Stages are added to the chain only when active:
+    // penalties -> top-k -> typical -> top-p -> min-p -> temperature -> dist (greedy if temperature <= 0)
+    struct SamplerConfig {
+        float temperature = 0.8f;
+        float topP = 0.95f;
+        int topK = 0;              // 0 disables
+        float minP = 0.0f;         // 0 disables
+        float typicalP = 1.0f;     // 1 disables
+        int penaltyLastN = 64;     // tokens considered by the penalties, -1 for the whole context
+        float repeatPenalty = 1.0f;
+        float frequencyPenalty = 0.0f;
+        float presencePenalty = 0.0f;
+        uint32_t seed = LLAMA_DEFAULT_SEED;
+        // Generation ends as soon as the output contains one of stopStrings (cut from the result, even
+        // across token boundaries) or samples one of stopTokens
+        std::vector<std::string> stopStrings;
+        std::vector<llama_token> stopTokens;
+    };
+    
+    // Timings of one generateText/chatCompletion call; as a running total the same fields are summed
+    struct RequestPerf {
+        size_t promptTokens = 0;
+        size_t prefilledTokens = 0;  // prompt tokens decoded after KV prefix reuse
+        size_t generatedTokens = 0;
+        double prefillMs = 0;
+        double decodeMs = 0;
+        double ttftMs = 0;
+        double samplingMs = 0;       // llama.cpp sampler perf counter
+        size_t sampledTokens = 0;
+        double prefillEvalMs = 0;    // llama.cpp context perf counters: compute time only
+        double decodeEvalMs = 0;
+    };
+    
+    struct PerfStats {
+        RequestPerf last;
+        RequestPerf total;
+        uint64_t requests = 0;
+        size_t kvUsed = 0;  // KV cells held by all sequences
+        size_t kvSize = 0;
+        size_t kvBytes = 0;  // memory of the main context's K and V buffers
+    };
+    
+    struct SpeculativeStats {
+        uint64_t drafted = 0;
+        uint64_t accepted = 0;
+    };
+    
+    // Time limits of generateText/chatCompletion requests in milliseconds, 0 for none: the prompt
+    // prefill, the whole request, and the wait for each next token. A request past a deadline stops
+    // within one ubatch and returns the text generated so far.
+    struct Deadlines {
+        double prefillMs = 0;
+        double totalMs = 0;
+        double tokenGapMs = 0;
+    };
+    
+    // Why the last generateText/chatCompletion call ended: EOG or the token callback (Stop), maxTokens
+    // (Length), cancellation, one of the deadlines, or an error
+    enum class FinishReason { Stop, Length, Cancelled, PrefillDeadline, TotalDeadline, TokenDeadline, Error };
+    
+    // Memory pressure tiers, in the order of the system memory levels. Each tier includes the ones
+    // before it: Moderate frees the batch and embedding contexts and idle pooled models, Low saves
+    // the KV state of every conversation and frees the inference contexts, Critical also releases the
+    // model and its LoRA adapters. Chat history, sessions and settings survive every tier.
+    enum class MemoryPressure { None, Moderate, Low, Critical };
+    
+    struct LoraAdapterInfo {
+        std::string name;
+        std::string path;
+        float scale = 0.0f;  // 0 while detached
+    };
+    
     // Model management
+    bool loadModel(const std::string& modelPath, const LoadConfig& config);
     bool loadModel(const std::string& modelPath, int contextSize = 2048, int threads = 4);
+    // Loads the GGUF at offset/length of an open file, e.g. a file opened by the app or a raw resource
+    // descriptor, without copying it; the weights are mapped from the file itself. fd may be closed
+    // afterwards. llama.cpp maps models from the start of a file, so the range has to cover the whole
+    // file (length 0: to the end); a model embedded at an offset inside a package fails with an error.
+    bool loadModelFromFd(int fd, int64_t offset, int64_t length, const LoadConfig& config);
     void unloadModel();
     bool isModelLoaded() const;
+    // Model pool: unloaded models stay resident up to maxBytes (least-recently-used evicted first),
+    // so loading one again only creates a new context. Must be enabled before the first load;
+    // calling it again changes the budget.
+    bool enableModelPool(size_t maxBytes);
+    bool preloadModel(const std::string& modelPath, const LoadConfig& config);
+    ModelPool::Stats getModelPoolStats() const;
+    // Cancels the loadModel/preloadModel call in progress, if any, and returns whether there was one.
+    // Safe to call from any thread; it never affects a load that starts later.
+    bool cancelLoad();
     
-    // Text generation
-    std::string generateText(const std::string& prompt, int maxTokens = 100, float temperature = 0.8f, float topP = 0.95f);
+    // Text generation; temperature and topP, when given, update the default sampler config
+    std::string generateText(const std::string& prompt, int maxTokens = 100,
+                             std::optional<float> temperature = std::nullopt, std::optional<float> topP = std::nullopt,
+                             const TokenCallback& onToken = nullptr);
     
     // Chat functionality
-    std::string chatCompletion(const std::string& userInput, const std::string& systemPrompt = "");
+    std::string chatCompletion(const std::string& userInput, const std::string& systemPrompt = "",
+                               const TokenCallback& onToken = nullptr);
     void clearChatHistory();
     
-    // Status and info
+    // Sessions: independent conversations on their own sequence ids. sessionGenerateAsync() queues a turn
+    // and returns at once; the scheduler thread decodes all active sessions together in one batch per step
+    // and calls onDone when the turn is in the session's history. It returns false (see getLastError())
+    // if the turn cannot be queued. sessionGenerate() blocks the calling thread until the same completes.
+    int createSession(const std::string& systemPrompt = "");
+    // Does not wait for a running request: the scheduler frees the session's KV cells before its next step
+    bool destroySession(int sessionId);
+    bool sessionGenerateAsync(int sessionId, const std::string& userInput, int maxTokens,
+                              const TokenCallback& onToken, SessionDoneCallback onDone);
+    std::string sessionGenerate(int sessionId, const std::string& userInput, int maxTokens = 150,
+                                const TokenCallback& onToken = nullptr);
+    
+    // Performance of the last request and totals since the model was loaded
+    PerfStats getPerfStats() const;
+    
+    // N completions in parallel on a separate batch context: the longest common token prefix of the
+    // prompts is prefilled once and copied to every sequence, then all sequences decode in lockstep,
+    // one batch per step, each with its own sampler (default sampler config) and stop conditions.
+    // A completion ends at EOG, maxTokens or the first of stopStrings, which is not included.
+    std::vector<std::string> generateBatch(const std::vector<std::string>& prompts, int maxTokens = 100,
+                                           const std::vector<std::string>& stopStrings = {});
+    
+    // Sentence embeddings: texts are packed into as few llama_decode calls as possible, one sequence
+    // each, on a separate embeddings context created on first use. output receives texts.size()
+    // L2-normalized vectors of nEmbd floats back to back. pooling is MEAN, CLS or LAST.
+    bool embed(const std::vector<std::string>& texts, enum llama_pooling_type pooling, std::vector<float>& output,
+               int& nEmbd);
+    
+    // Sampler chains are built once per conversation and reset between requests. sessionId -1 is the
+    // generateText/chatCompletion conversation; its config takes effect with the next request.
+    bool setSamplerConfig(const SamplerConfig& config, int sessionId = -1);
+    
+    // Draft tokens proposed and accepted by the target model since the model was loaded
+    SpeculativeStats getSpeculativeStats() const;
+    
+    // Deadlines apply to every later generateText/chatCompletion call until changed
+    void setDeadlines(const Deadlines& deadlines);
+    FinishReason getLastFinishReason() const;
+    
+    // Prefill progress of the running generateText/chatCompletion call; pollable from any thread
+    void setPrefillProgressCallback(const ProgressCallback& onProgress);
+    void getPrefillProgress(size_t& processed, size_t& total) const;
+    
+    // On-disk KV cache for system prompts, shared across process restarts
+    bool enablePrefixCache(const std::string& directory, size_t maxBytes);
+    PrefixCache::Stats getPrefixCacheStats() const;
+    
+    // LoRA adapters of the loaded model: each file is read once, then attached, re-scaled or detached
+    // on the live contexts between requests without reloading the model. Changing the active set
+    // drops the KV cache, which holds the old weights' activations, and fails while session requests
+    // are running. Adapters are freed together with the model.
+    bool loadLoraAdapter(const std::string& name, const std::string& path);
+    bool setLoraAdapter(const std::string& name, float scale = 1.0f);  // scale 0 detaches
+    bool removeLoraAdapter(const std::string& name);
+    bool clearLoraAdapters();
+    bool unloadLoraAdapter(const std::string& name);
+    std::vector<LoraAdapterInfo> getLoraAdapters() const;
+    
+    // Cancellation: safe to call from any thread, stops the running decode within one ubatch
+    void requestAbort();
+    void clearAbort();
+    bool wasCancelled() const;
+    
+    // Releases memory for the given pressure level; the next request rebuilds what it needs. Returns
+    // the tier actually applied: contexts stay while session requests are running. Calling it
+    // directly simulates pressure on hosts without memory level callbacks.
+    MemoryPressure handleMemoryPressure(MemoryPressure level);
+    
+    // Status and info. Like the stats getters above, answered from a snapshot taken after every
+    // change, so none of them waits for a running request.
     std::string getModelInfo() const;
     std::string getLastError() const;
-
+    
 private:
+    // One user/assistant exchange together with its rendered text and the exact tokens it occupies
+    // in the transcript
+    struct ChatTurn {
+        std::string userInput;
+        std::string response;
+        std::string text;
+        std::vector<llama_token> tokens;
+    };
+    
+    struct SamplerDeleter {
+        void operator()(llama_sampler* sampler) const { llama_sampler_free(sampler); }
+    };
+    
+    // A conversation bound to one KV sequence; sequence 0 backs generateText/chatCompletion
+    struct Session {
+        llama_seq_id seqId = 0;
+        std::string systemPrompt;
+        std::string systemText;                 // systemPrompt rendered with the chat template
+        std::vector<llama_token> systemTokens;  // pinned at the start of the transcript
+        std::vector<ChatTurn> history;
+        std::vector<llama_token> cachedTokens;  // tokens currently held in the KV cache for seqId
+        SamplerConfig samplerConfig;
+        std::unique_ptr<llama_sampler, SamplerDeleter> sampler;  // built lazily from samplerConfig
+        Detokenizer detokenizer;  // reset per request
+        StopMatcher stopMatcher;  // rebuilt per request from samplerConfig
+        std::string spillFile;    // KV state saved under memory pressure, loaded back on next use
+        bool busy = false;
+    };
+    
+    // One queued session turn as seen by the scheduler; the prompt is built on the scheduler thread
+    struct SessionRequest {
+        std::shared_ptr<Session> session;
+        std::string userInput;
+        SessionDoneCallback onDone;
+        bool prepared = false;
+        std::vector<llama_token> promptTokens;
+        std::vector<llama_token> userTokens;
+        size_t nPrefilled = 0;  // prompt tokens already in the KV cache
+        int maxTokens = 0;
+        TokenCallback onToken;
+        llama_sampler* sampler = nullptr;  // owned by the session
+        llama_token lastToken = 0;
+        int32_t iBatch = -1;  // index of this request's logits in the current batch
+        size_t nBatched = 0;  // tokens this request contributed to the current batch
+        std::vector<llama_token> generated;
+        std::string result;
+        std::string error;
+        bool done = false;
+    };
+    
+    // What the stats and info getters report, copied under snapshotMutex_ by publishSnapshot()
+    struct Snapshot {
+        PerfStats perfStats;
+        SpeculativeStats speculativeStats;
+        std::vector<LoraAdapterInfo> loraAdapters;
+        ModelPool::Stats modelPoolStats;
+        PrefixCache::Stats prefixCacheStats;
+        std::string modelInfo = "No model loaded";
+    };
+    
+    struct LoraAdapter {
+        std::string path;
+        std::string fileId;  // file identity at load time, part of weightsId()
+        llama_adapter_lora* adapter = nullptr;
+        float scale = 0.0f;
+    };
+    
     struct llama_model* model_;
     struct llama_context* context_;
-    std::vector<std::string> chatHistory_;
+    struct llama_model* draftModel_;
+    struct llama_context* draftContext_;
+    llama_sampler* draftSampler_;
+    std::vector<llama_token> draftCachedTokens_;
+    size_t draftTokens_;
+    llama_context* embedContext_;
+    llama_context* batchContext_;
+    // Shared by every context; only one of them computes at a time under contextMutex_
+    ggml_threadpool* prefillThreadpool_;
+    ggml_threadpool* decodeThreadpool_;
+    size_t kvCacheBytes_;
+    size_t kvStateBaseBytes_;  // state size of an empty sequence, subtracted when measuring the cache
+    bool kvMeasured_;
+    int prefillThreads_;
+    int decodeThreads_;
+    CpuTopology cpuTopology_;
+    SpeculativeStats speculativeStats_;
+    LoadConfig loadConfig_;  // options of the loaded model, for contexts created later
+    PerfStats perfStats_;
+    Session defaultSession_;
+    std::unique_ptr<PrefixCache> prefixCache_;
+    std::unique_ptr<ModelPool> modelPool_;
+    std::string modelPath_;
+    int modelFd_;  // private duplicate behind a /proc/self/fd model path, -1 otherwise
+    std::string modelId_;  // description plus file identity of the base weights, see weightsId()
+    std::map<std::string, LoraAdapter> loraAdapters_;
+    std::string chatTemplate_;  // the model's template, empty for the plain User:/Assistant: format
     std::string lastError_;
-    bool modelLoaded_;
+    std::atomic<bool> modelLoaded_;  // read without locks by isModelLoaded()
+    std::atomic<bool> loadInProgress_;
+    std::atomic<bool> loadCancelRequested_;
+    LoadProgressCallback loadProgress_;
+    std::atomic<bool> abortRequested_;
+    bool abortArmed_;  // only the legacy generation path can be aborted
+    bool lastCancelled_;
+    Deadlines deadlines_;
+    std::chrono::steady_clock::time_point totalDeadline_;
+    // steady_clock ticks past which the abort callback stops llama_decode; INT64_MAX when disarmed
+    std::atomic<int64_t> abortDeadline_;
+    FinishReason deadlineReason_;  // the deadline abortDeadline_ stands for
+    FinishReason lastFinishReason_;
+    ProgressCallback prefillProgress_;
+    std::atomic<size_t> prefillProcessed_;
+    std::atomic<size_t> prefillTotal_;
+    
+    // contextMutex_ guards context_ and the KV cache; sessionMutex_ guards sessions_ and the scheduler queue.
+    // Paths that need both take them together with std::scoped_lock, so no thread holds sessionMutex_
+    // while it waits for a generation. errorMutex_, snapshotMutex_ and pendingMutex_ are leaves.
+    mutable std::mutex contextMutex_;
+    mutable std::mutex errorMutex_;
+    mutable std::mutex snapshotMutex_;
+    Snapshot snapshot_;
+    std::mutex pendingMutex_;
+    std::unique_ptr<SamplerConfig> pendingSamplerConfig_;  // setSamplerConfig(-1) not yet applied
+    std::mutex sessionMutex_;
+    std::vector<llama_seq_id> retiredSeqIds_;  // destroyed sessions whose KV cells are still in use
+    std::condition_variable schedulerCv_;
+    std::map<int, std::shared_ptr<Session>> sessions_;
+    std::vector<std::shared_ptr<SessionRequest>> activeRequests_;
+    std::thread schedulerThread_;
+    std::atomic<bool> schedulerStop_;  // also read by prefillTokens() to cut a session's prefill short
     
+    static bool abortCallback(void* data);
+    void armRequest();
+    void disarmRequest();
+    void armDeadline(FinishReason phase);
+    bool deadlineExpired() const;
+    bool recordInterruption();
+    static bool loadProgressCallback(float progress, void* data);
+    void beginLoad();
+    bool endLoad();
+    llama_model_params modelParams(const LoadConfig& config);
+    void createThreadpools(const LoadConfig& config);
+    void freeThreadpools();
+    void setupThreads(llama_context_params& params) const;
+    static bool setupKvCache(const LoadConfig& config, llama_context_params& params, std::string& error);
+    void attachThreadpools(llama_context* context) const;
+    llama_model* acquireModel(const std::string& path, const llama_model_params& params);
+    void releaseModel(llama_model* model);
+    size_t sequenceBudget() const;
+    bool loraChangeAllowed();
+    void attachLoraAdapters(llama_context* context) const;
+    void applyLoraAdapters();
+    void freeLoraAdapters();
+    std::string weightsId() const;
+    void publishSnapshot();
+    MemoryPressure releaseMemory(MemoryPressure level);
+    std::string describeModel() const;
+    void applyPendingSamplerConfig();
+    size_t reuseCachedPrefix(Session& session, const std::vector<llama_token>& tokens);
+    bool buildChatPrompt(Session& session, const std::string& userInput, int maxResponseTokens,
+                         std::vector<llama_token>& userTokens, std::vector<llama_token>& promptTokens);
+    int prefillTokens(Session& session, const std::vector<llama_token>& tokens, size_t from);
+    void measureKvCache(const Session& session);
+    bool loadModelOwningFd(const std::string& modelPath, const LoadConfig& config, int ownedFd);
+    void closeModelFd();  // requires contextMutex_
+    bool primeSystemPrefix(Session& session);
+    void appendChatTurn(Session& session, const std::string& userInput, const std::string& response,
+                        const std::vector<llama_token>& userTokens, const std::vector<llama_token>& generated);
+    std::string rebaseTranscript(Session& session, const std::string& rendered);
+    std::string generateTokens(const std::vector<llama_token>& promptTokens, int maxTokens,
+                               const TokenCallback& onToken, size_t nKeep, std::vector<llama_token>* generated);
+    static llama_sampler* createSampler(const SamplerConfig& config);
+    llama_sampler* prepareSampler(Session& session, const std::vector<llama_token>& promptTokens);
+    bool loadDraftModel(const LoadConfig& config);
+    bool createContext(const LoadConfig& config);
+    bool createDraftContext(const LoadConfig& config);
+    bool ensureResident();
+    std::string spillPath(llama_seq_id seqId) const;
+    void spillSequence(Session& session);
+    void restoreSpilledSequence(Session& session);
+    void discardSpilledSequence(Session& session);
+    int speculativeDecode(Session& session, llama_sampler* sampler, int maxTokens, const TokenCallback& onToken,
+                          size_t nKeep, std::vector<llama_token>* generated, std::string& result);
+    std::vector<llama_token> draftContinuation(const std::vector<llama_token>& tokens, llama_token last,
+                                               size_t nDraft);
+    bool ensureBatchContext();
+    bool ensureEmbeddingContext(enum llama_pooling_type pooling);
+    void evictOldestTurn(Session& session);
+    bool shiftContext(Session& session, size_t nKeep);
+    void startScheduler();
+    void stopScheduler();
+    void schedulerLoop();
+    void schedulerStep(const std::vector<std::shared_ptr<SessionRequest>>& requests, llama_batch& batch);
+    void prepareSessionRequest(SessionRequest& request);
+    void finishSessionRequest(SessionRequest& request);
+    std::vector<std::string> chatStopStrings(const SamplerConfig& config) const;
+    std::vector<llama_chat_message> chatMessages(const Session& session) const;
+    std::string transcriptText(const Session& session) const;
+    std::string renderChat(const std::vector<llama_chat_message>& messages, bool addAssistant) const;
+    static size_t commonPrefixLength(const std::string& a, const std::string& b);
     void setError(const std::string& error);
-    std::vector<int> tokenize(const std::string& text) const;
-    std::string detokenize(const std::vector<int>& tokens) const;
+    std::vector<llama_token> tokenize(const std::string& text, bool addSpecial = true) const;
+    std::string detokenize(const std::vector<llama_token>& tokens) const;
 };
 
 #endif // LLAMA_CPP_INTERFACE_H
\ No newline at end of file
@@ -1,23 +1,711 @@
 #include "LlamaCppNapi.h"
 #include "LlamaCppInterface.h"
+#include "StreamSink.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 // Global instance of LlamaCpp interface
 static std::unique_ptr<LlamaCppInterface> g_llamaCpp = nullptr;
 
+// Serializes access to g_llamaCpp between the JS thread, streaming threads and async work
+static std::mutex g_llamaMutex;
+
+// Bookkeeping for cancel(requestId): pending ids, ids cancelled before they started, and the running one
+static std::mutex g_requestMutex;
+static std::unordered_set<int64_t> g_pendingRequests;
+static std::unordered_set<int64_t> g_cancelledRequests;
+static int64_t g_activeRequestId = -1;
+
+// Async loads queued or running, so cancelLoad() cannot leak into a later load
+static std::atomic<int> g_pendingLoads{0};
+
+// Bumped by unloadModel(): loads queued before it resolve as cancelled instead of loading afterwards
+static std::atomic<int64_t> g_loadGeneration{0};
+
 namespace LlamaCppNapi {
 
+    // The instance is created once and never destroyed, so the pointer can be used without g_llamaMutex
+    // by calls that synchronize inside the interface (sessions, progress polling)
     static LlamaCppInterface* getInstance() {
-        if (!g_llamaCpp) {
-            g_llamaCpp = std::make_unique<LlamaCppInterface>();
-        }
+        static std::once_flag once;
+        std::call_once(once, [] { g_llamaCpp = std::make_unique<LlamaCppInterface>(); });
         return g_llamaCpp.get();
     }
 
+    static std::string getStringArg(napi_env env, napi_value value) {
+        size_t len = 0;
+        napi_get_value_string_utf8(env, value, nullptr, 0, &len);
+        std::string str(len, '\0');
+        napi_get_value_string_utf8(env, value, &str[0], len + 1, &len);
+        return str;
+    }
+
+    // Leaves value empty for undefined or non-numeric arguments, so omitted sampling options keep the config
+    static void getOptionalFloatArg(napi_env env, napi_value value, std::optional<float> &result) {
+        double number = 0;
+        if (value != nullptr && napi_get_value_double(env, value, &number) == napi_ok) {
+            result = static_cast<float>(number);
+        }
+    }
+
+    static void getIntProperty(napi_env env, napi_value object, const char *name, int &value) {
+        bool hasProperty = false;
+        napi_value property;
+        if (napi_has_named_property(env, object, name, &hasProperty) == napi_ok && hasProperty &&
+            napi_get_named_property(env, object, name, &property) == napi_ok) {
+            napi_get_value_int32(env, property, &value);
+        }
+    }
+
+    static void getFloatProperty(napi_env env, napi_value object, const char *name, float &value) {
+        bool hasProperty = false;
+        napi_value property;
+        double number = 0;
+        if (napi_has_named_property(env, object, name, &hasProperty) == napi_ok && hasProperty &&
+            napi_get_named_property(env, object, name, &property) == napi_ok &&
+            napi_get_value_double(env, property, &number) == napi_ok) {
+            value = static_cast<float>(number);
+        }
+    }
+
+    static void getBoolProperty(napi_env env, napi_value object, const char *name, bool &value) {
+        bool hasProperty = false;
+        napi_value property;
+        if (napi_has_named_property(env, object, name, &hasProperty) == napi_ok && hasProperty &&
+            napi_get_named_property(env, object, name, &property) == napi_ok) {
+            napi_get_value_bool(env, property, &value);
+        }
+    }
+
+    static void getStringProperty(napi_env env, napi_value object, const char *name, std::string &value) {
+        bool hasProperty = false;
+        napi_value property;
+        if (napi_has_named_property(env, object, name, &hasProperty) == napi_ok && hasProperty &&
+            napi_get_named_property(env, object, name, &property) == napi_ok) {
+            value = getStringArg(env, property);
+        }
+    }
+
+    static bool getKvCacheType(napi_env env, napi_value object, const char *name, enum ggml_type &type) {
+        std::string value;
+        getStringProperty(env, object, name, value);
+        if (value.empty() || value == "f16") {
+            return true;
+        }
+        if (value == "q8_0") {
+            type = GGML_TYPE_Q8_0;
+        } else if (value == "q4_0") {
+            type = GGML_TYPE_Q4_0;
+        } else {
+            std::string message = std::string(name) + " must be 'f16', 'q8_0' or 'q4_0'";
+            napi_throw_error(env, nullptr, message.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Load options follow the model path either as a LoadConfig object or positionally as
+    // (contextSize, threads, maxSessions, batchSize, ubatchSize). Throws and returns false on invalid options.
+    static bool getLoadConfig(napi_env env, const napi_value *args, size_t argc,
+                              LlamaCppInterface::LoadConfig &config) {
+        napi_valuetype type = napi_undefined;
+        if (argc >= 2 && napi_typeof(env, args[1], &type) == napi_ok && type == napi_object) {
+            getIntProperty(env, args[1], "contextSize", config.contextSize);
+            getIntProperty(env, args[1], "threads", config.threads);
+            getIntProperty(env, args[1], "maxSessions", config.maxSessions);
+            getIntProperty(env, args[1], "batchSize", config.batchSize);
+            getIntProperty(env, args[1], "ubatchSize", config.ubatchSize);
+            getStringProperty(env, args[1], "draftModelPath", config.draftModelPath);
+            getStringProperty(env, args[1], "spillDirectory", config.spillDirectory);
+            getIntProperty(env, args[1], "draftTokens", config.draftTokens);
+            getBoolProperty(env, args[1], "useMmap", config.useMmap);
+            getBoolProperty(env, args[1], "useMlock", config.useMlock);
+            getBoolProperty(env, args[1], "checkTensors", config.checkTensors);
+            getIntProperty(env, args[1], "prefillThreads", config.prefillThreads);
+            getIntProperty(env, args[1], "decodeThreads", config.decodeThreads);
+            getBoolProperty(env, args[1], "pinThreads", config.pinThreads);
+            std::string priority;
+            getStringProperty(env, args[1], "threadPriority", priority);
+            if (priority == "low") {
+                config.threadPriority = GGML_SCHED_PRIO_LOW;
+            } else if (priority == "medium") {
+                config.threadPriority = GGML_SCHED_PRIO_MEDIUM;
+            } else if (priority == "high") {
+                config.threadPriority = GGML_SCHED_PRIO_HIGH;
+            } else if (priority == "realtime") {
+                config.threadPriority = GGML_SCHED_PRIO_REALTIME;
+            }
+            int pollLevel = static_cast<int>(config.pollLevel);
+            getIntProperty(env, args[1], "pollLevel", pollLevel);
+            config.pollLevel = static_cast<uint32_t>(std::max(0, pollLevel));
+            if (!getKvCacheType(env, args[1], "kvCacheTypeK", config.kvCacheTypeK) ||
+                !getKvCacheType(env, args[1], "kvCacheTypeV", config.kvCacheTypeV)) {
+                return false;
+            }
+            std::string flashAttention;
+            getStringProperty(env, args[1], "flashAttention", flashAttention);
+            if (flashAttention == "on") {
+                config.flashAttention = LLAMA_FLASH_ATTN_TYPE_ENABLED;
+            } else if (flashAttention == "off") {
+                config.flashAttention = LLAMA_FLASH_ATTN_TYPE_DISABLED;
+            } else if (!flashAttention.empty() && flashAttention != "auto") {
+                napi_throw_error(env, nullptr, "flashAttention must be 'auto', 'on' or 'off'");
+                return false;
+            }
+            getBoolProperty(env, args[1], "offloadKv", config.offloadKv);
+            getFloatProperty(env, args[1], "defragThreshold", config.defragThreshold);
+            return true;
+        }
+        if (argc >= 2) {
+            napi_get_value_int32(env, args[1], &config.contextSize);
+        }
+        if (argc >= 3) {
+            napi_get_value_int32(env, args[2], &config.threads);
+        }
+        if (argc >= 4) {
+            napi_get_value_int32(env, args[3], &config.maxSessions);
+        }
+        if (argc >= 5) {
+            napi_get_value_int32(env, args[4], &config.batchSize);
+        }
+        if (argc >= 6) {
+            napi_get_value_int32(env, args[5], &config.ubatchSize);
+        }
+        return true;
+    }
+
+    // Optional trailing deadlines object of the async generation calls
+    static bool getDeadlines(napi_env env, napi_value value, LlamaCppInterface::Deadlines &deadlines) {
+        napi_valuetype type = napi_undefined;
+        if (napi_typeof(env, value, &type) != napi_ok || type != napi_object) {
+            return false;
+        }
+        float prefillMs = 0;
+        float totalMs = 0;
+        float tokenGapMs = 0;
+        getFloatProperty(env, value, "prefillMs", prefillMs);
+        getFloatProperty(env, value, "totalMs", totalMs);
+        getFloatProperty(env, value, "tokenGapMs", tokenGapMs);
+        deadlines.prefillMs = prefillMs;
+        deadlines.totalMs = totalMs;
+        deadlines.tokenGapMs = tokenGapMs;
+        return true;
+    }
+
+    static const char *finishReasonName(LlamaCppInterface::FinishReason reason) {
+        switch (reason) {
+            case LlamaCppInterface::FinishReason::Stop: return "stop";
+            case LlamaCppInterface::FinishReason::Length: return "length";
+            case LlamaCppInterface::FinishReason::Cancelled: return "cancelled";
+            case LlamaCppInterface::FinishReason::PrefillDeadline: return "prefill_deadline";
+            case LlamaCppInterface::FinishReason::TotalDeadline: return "total_deadline";
+            case LlamaCppInterface::FinishReason::TokenDeadline: return "token_deadline";
+            default: return "error";
+        }
+    }
+
+    // Chunks a stream may have queued for the JS thread before further pieces are coalesced
+    static constexpr size_t kStreamMaxInFlight = 4;
+
+    // State shared by one streaming request. The threadsafe function is created once per request and
+    // reused for every chunk; it owns the context, and its finalizer joins the worker and frees it.
+    struct StreamContext {
+        napi_threadsafe_function tsfn = nullptr;
+        StreamSink sink;
+        std::thread worker;
+        bool isChat = false;
+        std::string prompt;
+        std::string systemPrompt;
+        int maxTokens = 100;
+        std::optional<float> temperature;
+        std::optional<float> topP;
+
+        StreamContext()
+            : sink([this](StreamSink::Chunk *chunk) {
+                  return napi_call_threadsafe_function(tsfn, chunk, napi_tsfn_blocking) == napi_ok;
+              }, kStreamMaxInFlight) {}
+    };
+
+    // Streams whose threadsafe function has not been finalized yet, so unloadModel() can stop and join them
+    static std::mutex g_streamMutex;
+    static std::unordered_set<StreamContext *> g_activeStreams;
+
+    static void StreamCallJs(napi_env env, napi_value js_callback, void *context, void *data) {
+        StreamContext *streamContext = reinterpret_cast<StreamContext *>(context);
+        std::unique_ptr<StreamSink::Chunk> chunk(reinterpret_cast<StreamSink::Chunk *>(data));
+        if (chunk == nullptr) {
+            return;
+        }
+        if (env == nullptr || js_callback == nullptr) {
+            streamContext->sink.consumed(false);
+            return;
+        }
+
+        napi_value argv[3] = {nullptr};
+        size_t argc = 2;
+        napi_create_string_utf8(env, chunk->piece.c_str(), chunk->piece.length(), &argv[0]);
+        napi_get_boolean(env, chunk->done, &argv[1]);
+        if (!chunk->error.empty()) {
+            napi_create_string_utf8(env, chunk->error.c_str(), chunk->error.length(), &argv[2]);
+            argc = 3;
+        }
+        napi_value result = nullptr;
+        napi_call_function(env, nullptr, js_callback, argc, argv, &result);
+
+        // Returning false from the JS callback asks the worker to stop generating
+        bool keepGoing = true;
+        napi_valuetype resultType = napi_undefined;
+        if (result != nullptr && napi_typeof(env, result, &resultType) == napi_ok && resultType == napi_boolean) {
+            napi_get_value_bool(env, result, &keepGoing);
+        }
+        streamContext->sink.consumed(keepGoing);
+    }
+
+    static void StreamFinalize(napi_env env, void *finalizeData, void *hint) {
+        StreamContext *streamContext = reinterpret_cast<StreamContext *>(finalizeData);
+        {
+            std::lock_guard<std::mutex> lock(g_streamMutex);
+            g_activeStreams.erase(streamContext);
+        }
+        // The worker released the function as its last step, so this join does not wait on generation
+        if (streamContext->worker.joinable()) {
+            streamContext->worker.join();
+        }
+        delete streamContext;
+    }
+
+    static void StreamWorker(StreamContext *streamContext) {
+        StreamSink &sink = streamContext->sink;
+        auto onToken = [&sink](const std::string& piece) { return sink.push(piece); };
+
+        std::string error;
+        {
+            std::lock_guard<std::mutex> lock(g_llamaMutex);
+            LlamaCppInterface *instance = getInstance();
+            instance->clearAbort();
+            // A stream stopped while it waited for the lock does not start; one stopped from here on is aborted
+            if (!sink.stopRequested()) {
+                if (streamContext->isChat) {
+                    instance->chatCompletion(streamContext->prompt, streamContext->systemPrompt, onToken);
+                } else {
+                    instance->generateText(streamContext->prompt, streamContext->maxTokens,
+                                           streamContext->temperature, streamContext->topP, onToken);
+                }
+                if (instance->getLastFinishReason() == LlamaCppInterface::FinishReason::Error) {
+                    error = instance->getLastError();
+                }
+            }
+        }
+
+        sink.finish(error);
+        napi_release_threadsafe_function(streamContext->tsfn, napi_tsfn_release);
+    }
+
+    // Joins the workers of every stream started so far; they must already have been asked to stop
+    static void JoinStreamWorkers() {
+        std::vector<std::thread> workers;
+        {
+            std::lock_guard<std::mutex> lock(g_streamMutex);
+            for (StreamContext *stream : g_activeStreams) {
+                if (stream->worker.joinable()) {
+                    workers.push_back(std::move(stream->worker));
+                }
+            }
+        }
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    static bool StartStream(napi_env env, napi_value js_callback, StreamContext *streamContext) {
+        napi_valuetype valueType = napi_undefined;
+        napi_typeof(env, js_callback, &valueType);
+        if (valueType != napi_function) {
+            delete streamContext;
+            napi_throw_error(env, nullptr, "Missing onToken callback parameter");
+            return false;
+        }
+
+        napi_value workName;
+        napi_create_string_utf8(env, "LlamaCppStream", NAPI_AUTO_LENGTH, &workName);
+        if (napi_create_threadsafe_function(env, js_callback, nullptr, workName, 0, 1, streamContext, StreamFinalize,
+                                            streamContext, StreamCallJs, &streamContext->tsfn) != napi_ok) {
+            delete streamContext;
+            napi_throw_error(env, nullptr, "Failed to create stream callback");
+            return false;
+        }
+
+        // The finalizer runs on this thread, so it cannot see the context before worker is assigned
+        std::lock_guard<std::mutex> lock(g_streamMutex);
+        g_activeStreams.insert(streamContext);
+        streamContext->worker = std::thread(StreamWorker, streamContext);
+        return true;
+    }
+
+    struct AsyncRequestData {
+        enum class Kind {
+            LoadModel, PreloadModel, GenerateText, ChatCompletion, Embed, GenerateBatch,
+            LoadLoraAdapter, SetLoraAdapter, ClearLoraAdapters, UnloadLoraAdapter,
+            EnablePrefixCache, EnableModelPool, MemoryPressure
+        };
+
+        napi_async_work asyncWork = nullptr;
+        napi_deferred deferred = nullptr;
+        Kind kind = Kind::GenerateText;
+        int64_t requestId = -1;
+        std::string modelPath;  // or the adapter file of LoadLoraAdapter, the directory of EnablePrefixCache
+        // LoadModel from a byte range of an open file instead of modelPath when modelFd >= 0
+        int modelFd = -1;
+        int64_t modelOffset = 0;
+        int64_t modelLength = 0;
+        int64_t loadGeneration = 0;
+        std::string adapterName;
+        float loraScale = 1.0f;
+        size_t maxBytes = 0;  // budget of EnablePrefixCache and EnableModelPool
+        LlamaCppInterface::MemoryPressure memoryPressure = LlamaCppInterface::MemoryPressure::None;
+        LlamaCppInterface::LoadConfig loadConfig;
+        napi_threadsafe_function progressTsfn = nullptr;
+        std::string prompt;
+        std::string systemPrompt;
+        int maxTokens = 100;
+        std::optional<float> temperature;
+        std::optional<float> topP;
+        std::vector<std::string> texts;
+        enum llama_pooling_type pooling = LLAMA_POOLING_TYPE_MEAN;
+        std::vector<float> embeddings;
+        std::vector<std::string> stopStrings;
+        std::vector<std::string> results;
+        // With deadlines the promise resolves to a GenerationResult instead of a string
+        bool hasDeadlines = false;
+        LlamaCppInterface::Deadlines deadlines;
+        LlamaCppInterface::FinishReason finishReason = LlamaCppInterface::FinishReason::Stop;
+        bool success = false;
+        bool cancelled = false;
+        std::string result;
+        std::string error;
+    };
+
+    // Marks requestId as running; returns false if it was cancelled while still queued
+    static bool BeginRequest(int64_t requestId) {
+        std::lock_guard<std::mutex> lock(g_requestMutex);
+        if (g_cancelledRequests.erase(requestId) > 0) {
+            return false;
+        }
+        g_activeRequestId = requestId;
+        getInstance()->clearAbort();
+        return true;
+    }
+
+    static void EndRequest(int64_t requestId) {
+        std::lock_guard<std::mutex> lock(g_requestMutex);
+        g_activeRequestId = -1;
+        g_pendingRequests.erase(requestId);
+        g_cancelledRequests.erase(requestId);
+        // A cancel that arrived after the generation finished must not abort the next request
+        getInstance()->clearAbort();
+    }
+
+    // Stops the running async request and every stream so a JS-thread call that needs g_llamaMutex waits at
+    // most one ubatch instead of a whole generation. Streams still waiting for the lock end without generating.
+    static void AbortActiveRequest() {
+        bool abort = false;
+        {
+            std::lock_guard<std::mutex> lock(g_requestMutex);
+            abort = g_activeRequestId >= 0;
+        }
+        {
+            std::lock_guard<std::mutex> lock(g_streamMutex);
+            for (StreamContext *stream : g_activeStreams) {
+                if (!stream->sink.finished()) {
+                    stream->sink.requestStop();
+                    abort = true;
+                }
+            }
+        }
+        if (abort) {
+            getInstance()->requestAbort();
+        }
+    }
+
+    // Stops the running load and turns the queued ones into cancelled no-ops. A load that finishes before it
+    // notices is unloaded again by AsyncRequestExecuteCB.
+    static void CancelPendingLoads() {
+        g_loadGeneration++;
+        getInstance()->cancelLoad();
+    }
+
+    // Adapter and cache configuration: queued like any request so they wait for g_llamaMutex on a worker
+    // instead of the JS thread, and resolved to a boolean
+    static bool IsConfigRequest(AsyncRequestData::Kind kind) {
+        switch (kind) {
+            case AsyncRequestData::Kind::LoadLoraAdapter:
+            case AsyncRequestData::Kind::SetLoraAdapter:
+            case AsyncRequestData::Kind::ClearLoraAdapters:
+            case AsyncRequestData::Kind::UnloadLoraAdapter:
+            case AsyncRequestData::Kind::EnablePrefixCache:
+            case AsyncRequestData::Kind::EnableModelPool:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static bool ApplyConfigRequest(LlamaCppInterface *instance, const AsyncRequestData &request) {
+        switch (request.kind) {
+            case AsyncRequestData::Kind::LoadLoraAdapter:
+                return instance->loadLoraAdapter(request.adapterName, request.modelPath);
+            case AsyncRequestData::Kind::SetLoraAdapter:
+                return instance->setLoraAdapter(request.adapterName, request.loraScale);
+            case AsyncRequestData::Kind::ClearLoraAdapters:
+                return instance->clearLoraAdapters();
+            case AsyncRequestData::Kind::UnloadLoraAdapter:
+                return instance->unloadLoraAdapter(request.adapterName);
+            case AsyncRequestData::Kind::EnablePrefixCache:
+                return instance->enablePrefixCache(request.modelPath, request.maxBytes);
+            case AsyncRequestData::Kind::EnableModelPool:
+                return instance->enableModelPool(request.maxBytes);
+            default:
+                return false;
+        }
+    }
+
+    static void AsyncRequestExecuteCB(napi_env env, void *data) {
+        AsyncRequestData *asyncContext = reinterpret_cast<AsyncRequestData *>(data);
+
+        std::lock_guard<std::mutex> lock(g_llamaMutex);
+        LlamaCppInterface *instance = getInstance();
+
+        if (asyncContext->kind == AsyncRequestData::Kind::LoadModel ||
+            asyncContext->kind == AsyncRequestData::Kind::PreloadModel) {
+            if (asyncContext->loadGeneration != g_loadGeneration) {
+                asyncContext->error = "Model load cancelled";
+                return;
+            }
+            if (asyncContext->progressTsfn != nullptr) {
+                // The loader reports many small steps; forward at most one update per percent
+                napi_threadsafe_function tsfn = asyncContext->progressTsfn;
+                int lastPercent = -1;
+                asyncContext->loadConfig.onProgress = [tsfn, lastPercent](float progress) mutable {
+                    int percent = static_cast<int>(progress * 100.0f);
+                    if (percent != lastPercent) {
+                        lastPercent = percent;
+                        float *value = new float(progress);
+                        if (napi_call_threadsafe_function(tsfn, value, napi_tsfn_nonblocking) != napi_ok) {
+                            delete value;
+                        }
+                    }
+                    return true;
+                };
+            }
+            if (asyncContext->kind == AsyncRequestData::Kind::PreloadModel) {
+                asyncContext->success = instance->preloadModel(asyncContext->modelPath, asyncContext->loadConfig);
+            } else if (asyncContext->modelFd >= 0) {
+                asyncContext->success = instance->loadModelFromFd(asyncContext->modelFd, asyncContext->modelOffset,
+                                                                  asyncContext->modelLength, asyncContext->loadConfig);
+            } else {
+                asyncContext->success = instance->loadModel(asyncContext->modelPath, asyncContext->loadConfig);
+            }
+            if (asyncContext->success && asyncContext->loadGeneration != g_loadGeneration) {
+                if (asyncContext->kind == AsyncRequestData::Kind::LoadModel) {
+                    instance->unloadModel();
+                }
+                asyncContext->success = false;
+                asyncContext->error = "Model load cancelled";
+            }
+            if (!asyncContext->success && asyncContext->error.empty()) {
+                asyncContext->error = instance->getLastError();
+            }
+            return;
+        }
+
+        if (asyncContext->kind == AsyncRequestData::Kind::MemoryPressure) {
+            asyncContext->memoryPressure = instance->handleMemoryPressure(asyncContext->memoryPressure);
+            asyncContext->success = true;
+            return;
+        }
+
+        if (IsConfigRequest(asyncContext->kind)) {
+            asyncContext->success = ApplyConfigRequest(instance, *asyncContext);
+            if (!asyncContext->success) {
+                asyncContext->error = instance->getLastError();
+            }
+            return;
+        }
+
+        if (asyncContext->kind == AsyncRequestData::Kind::Embed) {
+            int nEmbd = 0;
+            asyncContext->success = instance->embed(asyncContext->texts, asyncContext->pooling,
+                                                    asyncContext->embeddings, nEmbd);
+            if (!asyncContext->success) {
+                asyncContext->error = instance->getLastError();
+            }
+            return;
+        }
+
+        if (!BeginRequest(asyncContext->requestId)) {
+            asyncContext->cancelled = true;
+            EndRequest(asyncContext->requestId);
+            return;
+        }
+
+        if (asyncContext->kind == AsyncRequestData::Kind::GenerateBatch) {
+            asyncContext->results = instance->generateBatch(asyncContext->texts, asyncContext->maxTokens,
+                                                            asyncContext->stopStrings);
+            asyncContext->cancelled = instance->wasCancelled();
+            asyncContext->success = !asyncContext->cancelled && !asyncContext->results.empty();
+            if (!asyncContext->success) {
+                asyncContext->error = instance->getLastError();
+            }
+            EndRequest(asyncContext->requestId);
+            return;
+        }
+
+        if (asyncContext->hasDeadlines) {
+            instance->setDeadlines(asyncContext->deadlines);
+        }
+        if (asyncContext->kind == AsyncRequestData::Kind::ChatCompletion) {
+            asyncContext->result = instance->chatCompletion(asyncContext->prompt, asyncContext->systemPrompt);
+        } else {
+            asyncContext->result = instance->generateText(asyncContext->prompt, asyncContext->maxTokens,
+                                                          asyncContext->temperature, asyncContext->topP);
+        }
+        asyncContext->finishReason = instance->getLastFinishReason();
+        if (asyncContext->hasDeadlines) {
+            instance->setDeadlines(LlamaCppInterface::Deadlines());
+        }
+        asyncContext->cancelled = instance->wasCancelled();
+        // A request truncated by a deadline still succeeds, even before its first token
+        asyncContext->success = !asyncContext->cancelled &&
+            (asyncContext->hasDeadlines ? asyncContext->finishReason != LlamaCppInterface::FinishReason::Error
+                                        : !asyncContext->result.empty());
+        if (!asyncContext->success) {
+            asyncContext->error = instance->getLastError();
+        }
+        EndRequest(asyncContext->requestId);
+    }
+
+    static void LoadProgressCallJs(napi_env env, napi_value js_callback, void *context, void *data) {
+        std::unique_ptr<float> progress(reinterpret_cast<float *>(data));
+        if (env == nullptr || js_callback == nullptr || progress == nullptr) {
+            return;
+        }
+
+        napi_value argv[1] = {nullptr};
+        napi_create_double(env, *progress, &argv[0]);
+        napi_call_function(env, nullptr, js_callback, 1, argv, nullptr);
+    }
+
+    static void AsyncRequestCompleteCB(napi_env env, napi_status status, void *data) {
+        AsyncRequestData *asyncContext = reinterpret_cast<AsyncRequestData *>(data);
+
+        if (asyncContext->kind == AsyncRequestData::Kind::LoadModel ||
+            asyncContext->kind == AsyncRequestData::Kind::PreloadModel) {
+            g_pendingLoads--;
+            if (asyncContext->progressTsfn != nullptr) {
+                napi_release_threadsafe_function(asyncContext->progressTsfn, napi_tsfn_release);
+            }
+            napi_value result;
+            napi_get_boolean(env, asyncContext->success, &result);
+            napi_resolve_deferred(env, asyncContext->deferred, result);
+        } else if (asyncContext->kind == AsyncRequestData::Kind::MemoryPressure) {
+            // Same numbering as the system memory level, -1 when nothing was released
+            napi_value result;
+            napi_create_int32(env, static_cast<int32_t>(asyncContext->memoryPressure) - 1, &result);
+            napi_resolve_deferred(env, asyncContext->deferred, result);
+        } else if (IsConfigRequest(asyncContext->kind)) {
+            napi_value result;
+            napi_get_boolean(env, asyncContext->success, &result);
+            napi_resolve_deferred(env, asyncContext->deferred, result);
+        } else if (asyncContext->kind == AsyncRequestData::Kind::Embed && asyncContext->success) {
+            const size_t bytes = asyncContext->embeddings.size() * sizeof(float);
+            void *buffer = nullptr;
+            napi_value arrayBuffer;
+            napi_create_arraybuffer(env, bytes, &buffer, &arrayBuffer);
+            if (bytes > 0) {
+                memcpy(buffer, asyncContext->embeddings.data(), bytes);
+            }
+            napi_resolve_deferred(env, asyncContext->deferred, arrayBuffer);
+        } else if (asyncContext->kind == AsyncRequestData::Kind::GenerateBatch && asyncContext->success) {
+            napi_value results;
+            napi_create_array_with_length(env, asyncContext->results.size(), &results);
+            for (size_t i = 0; i < asyncContext->results.size(); ++i) {
+                napi_value text;
+                napi_create_string_utf8(env, asyncContext->results[i].c_str(), asyncContext->results[i].length(),
+                                        &text);
+                napi_set_element(env, results, static_cast<uint32_t>(i), text);
+            }
+            napi_resolve_deferred(env, asyncContext->deferred, results);
+        } else if (asyncContext->hasDeadlines && asyncContext->success) {
+            const LlamaCppInterface::FinishReason reason = asyncContext->finishReason;
+            const char *reasonName = finishReasonName(reason);
+            napi_value result;
+            napi_value text;
+            napi_value finishReason;
+            napi_value truncated;
+            napi_create_object(env, &result);
+            napi_create_string_utf8(env, asyncContext->result.c_str(), asyncContext->result.length(), &text);
+            napi_create_string_utf8(env, reasonName, strlen(reasonName), &finishReason);
+            napi_get_boolean(env,
+                             reason == LlamaCppInterface::FinishReason::PrefillDeadline ||
+                                 reason == LlamaCppInterface::FinishReason::TotalDeadline ||
+                                 reason == LlamaCppInterface::FinishReason::TokenDeadline,
+                             &truncated);
+            napi_set_named_property(env, result, "text", text);
+            napi_set_named_property(env, result, "finishReason", finishReason);
+            napi_set_named_property(env, result, "truncated", truncated);
+            napi_resolve_deferred(env, asyncContext->deferred, result);
+        } else if (asyncContext->success) {
+            napi_value contents;
+            napi_create_string_utf8(env, asyncContext->result.c_str(), asyncContext->result.length(), &contents);
+            napi_resolve_deferred(env, asyncContext->deferred, contents);
+        } else {
+            std::string message = asyncContext->cancelled ? "Request cancelled" : asyncContext->error;
+            napi_value msg;
+            napi_value error;
+            napi_create_string_utf8(env, message.c_str(), message.length(), &msg);
+            napi_create_error(env, nullptr, msg, &error);
+            napi_reject_deferred(env, asyncContext->deferred, error);
+        }
+
+        napi_delete_async_work(env, asyncContext->asyncWork);
+        delete asyncContext;
+    }
+
+    static napi_value QueueAsyncRequest(napi_env env, AsyncRequestData *asyncContext) {
+        if (asyncContext->kind == AsyncRequestData::Kind::GenerateText ||
+            asyncContext->kind == AsyncRequestData::Kind::ChatCompletion ||
+            asyncContext->kind == AsyncRequestData::Kind::GenerateBatch) {
+            std::lock_guard<std::mutex> lock(g_requestMutex);
+            if (!g_pendingRequests.insert(asyncContext->requestId).second) {
+                delete asyncContext;
+                napi_throw_error(env, nullptr, "Duplicate requestId");
+                return nullptr;
+            }
+        }
+
+        napi_value promise = nullptr;
+        napi_create_promise(env, &asyncContext->deferred, &promise);
+
+        napi_value asyncWorkName = nullptr;
+        napi_create_string_utf8(env, "LlamaCppAsyncRequest", NAPI_AUTO_LENGTH, &asyncWorkName);
+        napi_create_async_work(env, nullptr, asyncWorkName, AsyncRequestExecuteCB, AsyncRequestCompleteCB,
+                               asyncContext, &asyncContext->asyncWork);
+        napi_queue_async_work(env, asyncContext->asyncWork);
+        return promise;
+    }
+
     napi_value LoadModel(napi_env env, napi_callback_info info) {
-        size_t argc = 4;
-        napi_value args[4] = {nullptr};
+        size_t argc = 6;
+        napi_value args[6] = {nullptr};
         
         napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
         
@@ -33,17 +721,13 @@ namespace LlamaCppNapi {
         napi_get_value_string_utf8(env, args[0], &modelPath[0], pathLen + 1, &pathLen);
         
         // Get optional parameters
-        int contextSize = 2048;
-        int threads = 4;
-        
-        if (argc >= 2) {
-            napi_get_value_int32(env, args[1], &contextSize);
-        }
-        if (argc >= 3) {
-            napi_get_value_int32(env, args[2], &threads);
+        LlamaCppInterface::LoadConfig config;
+        if (!getLoadConfig(env, args, argc, config)) {
+            return nullptr;
         }
         
-        bool success = getInstance()->loadModel(modelPath, contextSize, threads);
+        std::lock_guard<std::mutex> lock(g_llamaMutex);
+        bool success = getInstance()->loadModel(modelPath, config);
         
         napi_value result;
         napi_get_boolean(env, success, &result);
@@ -51,11 +735,16 @@ namespace LlamaCppNapi {
     }
 
     napi_value UnloadModel(napi_env env, napi_callback_info info) {
+        AbortActiveRequest();
+        CancelPendingLoads();
+        JoinStreamWorkers();
+        std::lock_guard<std::mutex> lock(g_llamaMutex);
         getInstance()->unloadModel();
         return nullptr;
     }
 
     napi_value IsModelLoaded(napi_env env, napi_callback_info info) {
+        // Lock-free so the UI can poll it while an async load holds g_llamaMutex
         bool loaded = getInstance()->isModelLoaded();
         napi_value result;
         napi_get_boolean(env, loaded, &result);
@@ -81,23 +770,21 @@ namespace LlamaCppNapi {
         
         // Get optional parameters
         int maxTokens = 100;
-        float temperature = 0.8f;
-        float topP = 0.95f;
+        std::optional<float> temperature;
+        std::optional<float> topP;
         
         if (argc >= 2) {
             napi_get_value_int32(env, args[1], &maxTokens);
         }
         if (argc >= 3) {
-            double temp;
-            napi_get_value_double(env, args[2], &temp);
-            temperature = static_cast<float>(temp);
+            getOptionalFloatArg(env, args[2], temperature);
         }
         if (argc >= 4) {
-            double top_p;
-            napi_get_value_double(env, args[3], &top_p);
-            topP = static_cast<float>(top_p);
+            getOptionalFloatArg(env, args[3], topP);
         }
         
+        std::lock_guard<std::mutex> lock(g_llamaMutex);
+        getInstance()->clearAbort();
         std::string response = getInstance()->generateText(prompt, maxTokens, temperature, topP);
         
         napi_value result;
@@ -131,6 +818,8 @@ namespace LlamaCppNapi {
             napi_get_value_string_utf8(env, args[1], &systemPrompt[0], systemLen + 1, &systemLen);
         }
         
+        std::lock_guard<std::mutex> lock(g_llamaMutex);
+        getInstance()->clearAbort();
         std::string response = getInstance()->chatCompletion(userInput, systemPrompt);
         
         napi_value result;
@@ -138,12 +827,809 @@ namespace LlamaCppNapi {
         return result;
     }
 
+    napi_value GenerateTextStream(napi_env env, napi_callback_info info) {
+        size_t argc = 5;
+        napi_value args[5] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 2) {
+            napi_throw_error(env, nullptr, "Missing prompt or onToken parameter");
+            return nullptr;
+        }
+        
+        auto streamContext = new StreamContext();
+        streamContext->prompt = getStringArg(env, args[0]);
+        
+        if (argc >= 3) {
+            napi_get_value_int32(env, args[2], &streamContext->maxTokens);
+        }
+        if (argc >= 4) {
+            getOptionalFloatArg(env, args[3], streamContext->temperature);
+        }
+        if (argc >= 5) {
+            getOptionalFloatArg(env, args[4], streamContext->topP);
+        }
+        
+        StartStream(env, args[1], streamContext);
+        return nullptr;
+    }
+
+    napi_value ChatCompletionStream(napi_env env, napi_callback_info info) {
+        size_t argc = 3;
+        napi_value args[3] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 2) {
+            napi_throw_error(env, nullptr, "Missing user input or onToken parameter");
+            return nullptr;
+        }
+        
+        auto streamContext = new StreamContext();
+        streamContext->isChat = true;
+        streamContext->prompt = getStringArg(env, args[0]);
+        if (argc >= 3) {
+            streamContext->systemPrompt = getStringArg(env, args[2]);
+        }
+        
+        StartStream(env, args[1], streamContext);
+        return nullptr;
+    }
+
+    napi_value LoadModelAsync(napi_env env, napi_callback_info info) {
+        size_t argc = 6;
+        napi_value args[6] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing model path parameter");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::LoadModel;
+        asyncContext->modelPath = getStringArg(env, args[0]);
+        if (!getLoadConfig(env, args, argc, asyncContext->loadConfig)) {
+            delete asyncContext;
+            return nullptr;
+        }
+        
+        // loadModelAsync(path, config, onProgress): progress in [0, 1] is delivered on the JS thread
+        napi_valuetype type = napi_undefined;
+        if (argc >= 3 && napi_typeof(env, args[2], &type) == napi_ok && type == napi_function) {
+            napi_value workName;
+            napi_create_string_utf8(env, "LlamaCppLoadProgress", NAPI_AUTO_LENGTH, &workName);
+            if (napi_create_threadsafe_function(env, args[2], nullptr, workName, 0, 1, nullptr, nullptr, nullptr,
+                                                LoadProgressCallJs, &asyncContext->progressTsfn) != napi_ok) {
+                delete asyncContext;
+                napi_throw_error(env, nullptr, "Failed to create progress callback");
+                return nullptr;
+            }
+        }
+        
+        asyncContext->loadGeneration = g_loadGeneration;
+        g_pendingLoads++;
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    // loadModelFromFd(fd, offset, length, config?, onProgress?): the fd must stay open until the promise settles
+    napi_value LoadModelFromFd(napi_env env, napi_callback_info info) {
+        size_t argc = 5;
+        napi_value args[5] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 3) {
+            napi_throw_error(env, nullptr, "Missing fd, offset or length parameter");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::LoadModel;
+        napi_get_value_int32(env, args[0], &asyncContext->modelFd);
+        napi_get_value_int64(env, args[1], &asyncContext->modelOffset);
+        napi_get_value_int64(env, args[2], &asyncContext->modelLength);
+        if (asyncContext->modelFd < 0) {
+            delete asyncContext;
+            napi_throw_error(env, nullptr, "Invalid model fd");
+            return nullptr;
+        }
+        // llama.cpp maps a model from the first byte of its file, so a range inside a file is refused here
+        // instead of after the request has queued behind other work
+        struct stat st;
+        if (asyncContext->modelOffset != 0 ||
+            (asyncContext->modelLength > 0 &&
+             (fstat(asyncContext->modelFd, &st) != 0 || asyncContext->modelLength != st.st_size))) {
+            delete asyncContext;
+            napi_throw_error(env, nullptr, "Model offset and length must cover the whole file");
+            return nullptr;
+        }
+        // The config takes the place getLoadConfig expects right after a model path
+        if (argc >= 4 && !getLoadConfig(env, args + 2, 2, asyncContext->loadConfig)) {
+            delete asyncContext;
+            return nullptr;
+        }
+        
+        napi_valuetype type = napi_undefined;
+        if (argc >= 5 && napi_typeof(env, args[4], &type) == napi_ok && type == napi_function) {
+            napi_value workName;
+            napi_create_string_utf8(env, "LlamaCppLoadProgress", NAPI_AUTO_LENGTH, &workName);
+            if (napi_create_threadsafe_function(env, args[4], nullptr, workName, 0, 1, nullptr, nullptr, nullptr,
+                                                LoadProgressCallJs, &asyncContext->progressTsfn) != napi_ok) {
+                delete asyncContext;
+                napi_throw_error(env, nullptr, "Failed to create progress callback");
+                return nullptr;
+            }
+        }
+        
+        asyncContext->loadGeneration = g_loadGeneration;
+        g_pendingLoads++;
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value PreloadModel(napi_env env, napi_callback_info info) {
+        size_t argc = 2;
+        napi_value args[2] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing model path parameter");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::PreloadModel;
+        asyncContext->modelPath = getStringArg(env, args[0]);
+        if (!getLoadConfig(env, args, argc, asyncContext->loadConfig)) {
+            delete asyncContext;
+            return nullptr;
+        }
+        
+        asyncContext->loadGeneration = g_loadGeneration;
+        g_pendingLoads++;
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value CancelLoad(napi_env env, napi_callback_info info) {
+        bool pending = g_pendingLoads > 0;
+        if (pending) {
+            CancelPendingLoads();
+        }
+        napi_value result;
+        napi_get_boolean(env, pending, &result);
+        return result;
+    }
+
+    // level is the system memory level: 0 moderate, 1 low, 2 critical
+    napi_value HandleMemoryPressure(napi_env env, napi_callback_info info) {
+        size_t argc = 1;
+        napi_value args[1] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing memory level parameter");
+            return nullptr;
+        }
+        
+        int level = -1;
+        napi_get_value_int32(env, args[0], &level);
+        if (level < 0 || level > 2) {
+            napi_throw_error(env, nullptr, "Memory level must be 0 (moderate), 1 (low) or 2 (critical)");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::MemoryPressure;
+        asyncContext->memoryPressure = static_cast<LlamaCppInterface::MemoryPressure>(level + 1);
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value GenerateTextAsync(napi_env env, napi_callback_info info) {
+        size_t argc = 6;
+        napi_value args[6] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 2) {
+            napi_throw_error(env, nullptr, "Missing requestId or prompt parameter");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::GenerateText;
+        napi_get_value_int64(env, args[0], &asyncContext->requestId);
+        asyncContext->prompt = getStringArg(env, args[1]);
+        if (argc >= 3) {
+            napi_get_value_int32(env, args[2], &asyncContext->maxTokens);
+        }
+        if (argc >= 4) {
+            getOptionalFloatArg(env, args[3], asyncContext->temperature);
+        }
+        if (argc >= 5) {
+            getOptionalFloatArg(env, args[4], asyncContext->topP);
+        }
+        if (argc >= 6) {
+            asyncContext->hasDeadlines = getDeadlines(env, args[5], asyncContext->deadlines);
+        }
+        
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value ChatCompletionAsync(napi_env env, napi_callback_info info) {
+        size_t argc = 4;
+        napi_value args[4] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 2) {
+            napi_throw_error(env, nullptr, "Missing requestId or user input parameter");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::ChatCompletion;
+        napi_get_value_int64(env, args[0], &asyncContext->requestId);
+        asyncContext->prompt = getStringArg(env, args[1]);
+        if (argc >= 3) {
+            asyncContext->systemPrompt = getStringArg(env, args[2]);
+        }
+        if (argc >= 4) {
+            asyncContext->hasDeadlines = getDeadlines(env, args[3], asyncContext->deadlines);
+        }
+        
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value Cancel(napi_env env, napi_callback_info info) {
+        size_t argc = 1;
+        napi_value args[1] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing requestId parameter");
+            return nullptr;
+        }
+        
+        int64_t requestId = -1;
+        napi_get_value_int64(env, args[0], &requestId);
+        
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(g_requestMutex);
+            if (g_pendingRequests.count(requestId) > 0) {
+                found = true;
+                if (requestId == g_activeRequestId) {
+                    // The instance exists while a request is active; requestAbort() only touches an atomic
+                    g_llamaCpp->requestAbort();
+                } else {
+                    g_cancelledRequests.insert(requestId);
+                }
+            }
+        }
+        
+        napi_value result;
+        napi_get_boolean(env, found, &result);
+        return result;
+    }
+
+    napi_value CreateSession(napi_env env, napi_callback_info info) {
+        size_t argc = 1;
+        napi_value args[1] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        std::string systemPrompt = "";
+        if (argc >= 1) {
+            systemPrompt = getStringArg(env, args[0]);
+        }
+        
+        int sessionId = getInstance()->createSession(systemPrompt);
+        
+        napi_value result;
+        napi_create_int32(env, sessionId, &result);
+        return result;
+    }
+
+    napi_value DestroySession(napi_env env, napi_callback_info info) {
+        size_t argc = 1;
+        napi_value args[1] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing sessionId parameter");
+            return nullptr;
+        }
+        
+        int sessionId = -1;
+        napi_get_value_int32(env, args[0], &sessionId);
+        bool success = getInstance()->destroySession(sessionId);
+        
+        napi_value result;
+        napi_get_boolean(env, success, &result);
+        return result;
+    }
+
+    // A sessionGenerate() promise. The scheduler thread finishes the turn and settles the promise through
+    // tsfn, so no libuv worker waits on it and the number of concurrent sessions is not bound by the pool.
+    struct SessionRequestData {
+        napi_deferred deferred = nullptr;
+        napi_threadsafe_function tsfn = nullptr;
+        std::string result;
+        std::string error;
+    };
+
+    static void SettleSessionRequest(napi_env env, SessionRequestData *request) {
+        if (request->error.empty()) {
+            napi_value contents;
+            napi_create_string_utf8(env, request->result.c_str(), request->result.length(), &contents);
+            napi_resolve_deferred(env, request->deferred, contents);
+        } else {
+            napi_value msg;
+            napi_value error;
+            napi_create_string_utf8(env, request->error.c_str(), request->error.length(), &msg);
+            napi_create_error(env, nullptr, msg, &error);
+            napi_reject_deferred(env, request->deferred, error);
+        }
+    }
+
+    static void SessionDoneCallJs(napi_env env, napi_value js_callback, void *context, void *data) {
+        std::unique_ptr<SessionRequestData> request(reinterpret_cast<SessionRequestData *>(data));
+        if (env != nullptr) {
+            SettleSessionRequest(env, request.get());
+        }
+        napi_release_threadsafe_function(request->tsfn, napi_tsfn_release);
+    }
+
+    napi_value SessionGenerate(napi_env env, napi_callback_info info) {
+        size_t argc = 3;
+        napi_value args[3] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 2) {
+            napi_throw_error(env, nullptr, "Missing sessionId or user input parameter");
+            return nullptr;
+        }
+        
+        int sessionId = -1;
+        int maxTokens = 150;
+        napi_get_value_int32(env, args[0], &sessionId);
+        std::string userInput = getStringArg(env, args[1]);
+        if (argc >= 3) {
+            napi_get_value_int32(env, args[2], &maxTokens);
+        }
+        
+        auto request = new SessionRequestData();
+        napi_value workName;
+        napi_create_string_utf8(env, "LlamaCppSessionDone", NAPI_AUTO_LENGTH, &workName);
+        if (napi_create_threadsafe_function(env, nullptr, nullptr, workName, 0, 1, nullptr, nullptr, nullptr,
+                                            SessionDoneCallJs, &request->tsfn) != napi_ok) {
+            delete request;
+            napi_throw_error(env, nullptr, "Failed to create session callback");
+            return nullptr;
+        }
+        napi_value promise = nullptr;
+        napi_create_promise(env, &request->deferred, &promise);
+        
+        auto onDone = [request](const std::string& result, const std::string& error) {
+            request->result = result;
+            request->error = error;
+            if (napi_call_threadsafe_function(request->tsfn, request, napi_tsfn_blocking) != napi_ok) {
+                // The environment is shutting down and will not settle the promise anymore
+                delete request;
+            }
+        };
+        // Only takes the session lock: the prompt is built and decoded on the scheduler thread
+        if (!getInstance()->sessionGenerateAsync(sessionId, userInput, maxTokens, nullptr, onDone)) {
+            request->error = getInstance()->getLastError();
+            SettleSessionRequest(env, request);
+            napi_release_threadsafe_function(request->tsfn, napi_tsfn_release);
+            delete request;
+        }
+        return promise;
+    }
+
+    napi_value EnablePrefixCache(napi_env env, napi_callback_info info) {
+        size_t argc = 2;
+        napi_value args[2] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing cache directory parameter");
+            return nullptr;
+        }
+        
+        int maxMegabytes = 256;
+        if (argc >= 2) {
+            napi_get_value_int32(env, args[1], &maxMegabytes);
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::EnablePrefixCache;
+        asyncContext->modelPath = getStringArg(env, args[0]);
+        asyncContext->maxBytes = static_cast<size_t>(maxMegabytes) << 20;
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value LoadLoraAdapter(napi_env env, napi_callback_info info) {
+        size_t argc = 2;
+        napi_value args[2] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 2) {
+            napi_throw_error(env, nullptr, "Missing adapter name or path parameter");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::LoadLoraAdapter;
+        asyncContext->adapterName = getStringArg(env, args[0]);
+        asyncContext->modelPath = getStringArg(env, args[1]);
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value SetLoraAdapter(napi_env env, napi_callback_info info) {
+        size_t argc = 2;
+        napi_value args[2] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing adapter name parameter");
+            return nullptr;
+        }
+        
+        double scale = 1.0;
+        if (argc >= 2) {
+            napi_get_value_double(env, args[1], &scale);
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::SetLoraAdapter;
+        asyncContext->adapterName = getStringArg(env, args[0]);
+        asyncContext->loraScale = static_cast<float>(scale);
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value RemoveLoraAdapter(napi_env env, napi_callback_info info) {
+        size_t argc = 1;
+        napi_value args[1] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing adapter name parameter");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::SetLoraAdapter;
+        asyncContext->adapterName = getStringArg(env, args[0]);
+        asyncContext->loraScale = 0.0f;
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value ClearLoraAdapters(napi_env env, napi_callback_info info) {
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::ClearLoraAdapters;
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value UnloadLoraAdapter(napi_env env, napi_callback_info info) {
+        size_t argc = 1;
+        napi_value args[1] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing adapter name parameter");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::UnloadLoraAdapter;
+        asyncContext->adapterName = getStringArg(env, args[0]);
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    static void setNumberProperty(napi_env env, napi_value object, const char *name, double value) {
+        napi_value number;
+        napi_create_double(env, value, &number);
+        napi_set_named_property(env, object, name, number);
+    }
+
+    static bool getStringArrayArg(napi_env env, napi_value value, std::vector<std::string> &out) {
+        bool isArray = false;
+        if (napi_is_array(env, value, &isArray) != napi_ok || !isArray) {
+            return false;
+        }
+        uint32_t length = 0;
+        napi_get_array_length(env, value, &length);
+        out.reserve(length);
+        for (uint32_t i = 0; i < length; ++i) {
+            napi_value element;
+            napi_get_element(env, value, i, &element);
+            out.push_back(getStringArg(env, element));
+        }
+        return true;
+    }
+
+    napi_value GenerateBatch(napi_env env, napi_callback_info info) {
+        size_t argc = 4;
+        napi_value args[4] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 2) {
+            napi_throw_error(env, nullptr, "Missing requestId or prompts parameter");
+            return nullptr;
+        }
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::GenerateBatch;
+        napi_get_value_int64(env, args[0], &asyncContext->requestId);
+        if (!getStringArrayArg(env, args[1], asyncContext->texts)) {
+            delete asyncContext;
+            napi_throw_error(env, nullptr, "prompts must be an array of strings");
+            return nullptr;
+        }
+        if (argc >= 3) {
+            napi_get_value_int32(env, args[2], &asyncContext->maxTokens);
+        }
+        if (argc >= 4 && !getStringArrayArg(env, args[3], asyncContext->stopStrings)) {
+            delete asyncContext;
+            napi_throw_error(env, nullptr, "stop must be an array of strings");
+            return nullptr;
+        }
+        
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value Embed(napi_env env, napi_callback_info info) {
+        size_t argc = 2;
+        napi_value args[2] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::Embed;
+        if (argc < 1 || !getStringArrayArg(env, args[0], asyncContext->texts)) {
+            delete asyncContext;
+            napi_throw_error(env, nullptr, "Missing texts array parameter");
+            return nullptr;
+        }
+        
+        if (argc >= 2) {
+            std::string pooling = getStringArg(env, args[1]);
+            if (pooling == "cls") {
+                asyncContext->pooling = LLAMA_POOLING_TYPE_CLS;
+            } else if (pooling == "last") {
+                asyncContext->pooling = LLAMA_POOLING_TYPE_LAST;
+            } else if (pooling != "mean") {
+                delete asyncContext;
+                napi_throw_error(env, nullptr, "pooling must be 'mean', 'cls' or 'last'");
+                return nullptr;
+            }
+        }
+        
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value EnableModelPool(napi_env env, napi_callback_info info) {
+        size_t argc = 1;
+        napi_value args[1] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        if (argc < 1) {
+            napi_throw_error(env, nullptr, "Missing maxMegabytes parameter");
+            return nullptr;
+        }
+        
+        double maxMegabytes = 0;
+        napi_get_value_double(env, args[0], &maxMegabytes);
+        
+        auto asyncContext = new AsyncRequestData();
+        asyncContext->kind = AsyncRequestData::Kind::EnableModelPool;
+        asyncContext->maxBytes = static_cast<size_t>(maxMegabytes * 1024 * 1024);
+        return QueueAsyncRequest(env, asyncContext);
+    }
+
+    napi_value GetModelPoolStats(napi_env env, napi_callback_info info) {
+        ModelPool::Stats stats = getInstance()->getModelPoolStats();
+        
+        napi_value result;
+        napi_create_object(env, &result);
+        setNumberProperty(env, result, "hits", static_cast<double>(stats.hits));
+        setNumberProperty(env, result, "misses", static_cast<double>(stats.misses));
+        setNumberProperty(env, result, "evictions", static_cast<double>(stats.evictions));
+        setNumberProperty(env, result, "models", static_cast<double>(stats.models));
+        setNumberProperty(env, result, "bytes", static_cast<double>(stats.bytes));
+        return result;
+    }
+
+    napi_value GetPrefixCacheStats(napi_env env, napi_callback_info info) {
+        PrefixCache::Stats stats = getInstance()->getPrefixCacheStats();
+        
+        napi_value result;
+        napi_create_object(env, &result);
+        setNumberProperty(env, result, "hits", static_cast<double>(stats.hits));
+        setNumberProperty(env, result, "misses", static_cast<double>(stats.misses));
+        setNumberProperty(env, result, "saves", static_cast<double>(stats.saves));
+        setNumberProperty(env, result, "evictions", static_cast<double>(stats.evictions));
+        setNumberProperty(env, result, "entries", static_cast<double>(stats.entries));
+        setNumberProperty(env, result, "bytes", static_cast<double>(stats.bytes));
+        return result;
+    }
+
+    napi_value GetLoraAdapters(napi_env env, napi_callback_info info) {
+        std::vector<LlamaCppInterface::LoraAdapterInfo> adapters = getInstance()->getLoraAdapters();
+        
+        napi_value result;
+        napi_create_array_with_length(env, adapters.size(), &result);
+        for (size_t i = 0; i < adapters.size(); ++i) {
+            napi_value adapter;
+            napi_value name;
+            napi_value path;
+            napi_create_object(env, &adapter);
+            napi_create_string_utf8(env, adapters[i].name.c_str(), adapters[i].name.length(), &name);
+            napi_create_string_utf8(env, adapters[i].path.c_str(), adapters[i].path.length(), &path);
+            napi_set_named_property(env, adapter, "name", name);
+            napi_set_named_property(env, adapter, "path", path);
+            setNumberProperty(env, adapter, "scale", adapters[i].scale);
+            napi_set_element(env, result, static_cast<uint32_t>(i), adapter);
+        }
+        return result;
+    }
+
+    static napi_value createRequestPerf(napi_env env, const LlamaCppInterface::RequestPerf &perf) {
+        napi_value object;
+        napi_create_object(env, &object);
+        setNumberProperty(env, object, "promptTokens", static_cast<double>(perf.promptTokens));
+        setNumberProperty(env, object, "prefilledTokens", static_cast<double>(perf.prefilledTokens));
+        setNumberProperty(env, object, "generatedTokens", static_cast<double>(perf.generatedTokens));
+        setNumberProperty(env, object, "prefillMs", perf.prefillMs);
+        setNumberProperty(env, object, "decodeMs", perf.decodeMs);
+        setNumberProperty(env, object, "ttftMs", perf.ttftMs);
+        setNumberProperty(env, object, "samplingMs", perf.samplingMs);
+        setNumberProperty(env, object, "sampledTokens", static_cast<double>(perf.sampledTokens));
+        setNumberProperty(env, object, "samplingMsPerToken",
+                          perf.sampledTokens > 0 ? perf.samplingMs / perf.sampledTokens : 0.0);
+        setNumberProperty(env, object, "prefillEvalMs", perf.prefillEvalMs);
+        setNumberProperty(env, object, "decodeEvalMs", perf.decodeEvalMs);
+        setNumberProperty(env, object, "prefillTokensPerSecond",
+                          perf.prefillMs > 0 ? perf.prefilledTokens * 1000.0 / perf.prefillMs : 0.0);
+        setNumberProperty(env, object, "decodeTokensPerSecond",
+                          perf.decodeMs > 0 ? perf.generatedTokens * 1000.0 / perf.decodeMs : 0.0);
+        return object;
+    }
+
+    napi_value SetSamplerConfig(napi_env env, napi_callback_info info) {
+        size_t argc = 2;
+        napi_value args[2] = {nullptr};
+        
+        napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+        
+        napi_valuetype type = napi_undefined;
+        if (argc < 1 || napi_typeof(env, args[0], &type) != napi_ok || type != napi_object) {
+            napi_throw_error(env, nullptr, "Missing sampler config parameter");
+            return nullptr;
+        }
+        
+        // Unset fields keep their defaults
+        LlamaCppInterface::SamplerConfig config;
+        getFloatProperty(env, args[0], "temperature", config.temperature);
+        getFloatProperty(env, args[0], "topP", config.topP);
+        getIntProperty(env, args[0], "topK", config.topK);
+        getFloatProperty(env, args[0], "minP", config.minP);
+        getFloatProperty(env, args[0], "typicalP", config.typicalP);
+        getIntProperty(env, args[0], "penaltyLastN", config.penaltyLastN);
+        getFloatProperty(env, args[0], "repeatPenalty", config.repeatPenalty);
+        getFloatProperty(env, args[0], "frequencyPenalty", config.frequencyPenalty);
+        getFloatProperty(env, args[0], "presencePenalty", config.presencePenalty);
+        bool hasSeed = false;
+        napi_value seed;
+        if (napi_has_named_property(env, args[0], "seed", &hasSeed) == napi_ok && hasSeed &&
+            napi_get_named_property(env, args[0], "seed", &seed) == napi_ok) {
+            napi_get_value_uint32(env, seed, &config.seed);
+        }
+        bool hasStop = false;
+        napi_value stop;
+        if (napi_has_named_property(env, args[0], "stop", &hasStop) == napi_ok && hasStop &&
+            napi_get_named_property(env, args[0], "stop", &stop) == napi_ok &&
+            !getStringArrayArg(env, stop, config.stopStrings)) {
+            napi_throw_error(env, nullptr, "stop must be an array of strings");
+            return nullptr;
+        }
+        bool hasStopTokens = false;
+        napi_value stopTokens;
+        bool isArray = false;
+        if (napi_has_named_property(env, args[0], "stopTokens", &hasStopTokens) == napi_ok && hasStopTokens &&
+            napi_get_named_property(env, args[0], "stopTokens", &stopTokens) == napi_ok &&
+            napi_is_array(env, stopTokens, &isArray) == napi_ok && isArray) {
+            uint32_t length = 0;
+            napi_get_array_length(env, stopTokens, &length);
+            for (uint32_t i = 0; i < length; ++i) {
+                napi_value element;
+                int32_t token = 0;
+                napi_get_element(env, stopTokens, i, &element);
+                if (napi_get_value_int32(env, element, &token) == napi_ok) {
+                    config.stopTokens.push_back(token);
+                }
+            }
+        }
+        
+        int sessionId = -1;
+        if (argc >= 2) {
+            napi_get_value_int32(env, args[1], &sessionId);
+        }
+        
+        bool success = getInstance()->setSamplerConfig(config, sessionId);
+        napi_value result;
+        napi_get_boolean(env, success, &result);
+        return result;
+    }
+
+    napi_value GetPerfStats(napi_env env, napi_callback_info info) {
+        LlamaCppInterface::PerfStats stats = getInstance()->getPerfStats();
+        
+        napi_value result;
+        napi_create_object(env, &result);
+        napi_set_named_property(env, result, "last", createRequestPerf(env, stats.last));
+        napi_set_named_property(env, result, "total", createRequestPerf(env, stats.total));
+        setNumberProperty(env, result, "requests", static_cast<double>(stats.requests));
+        setNumberProperty(env, result, "averageTtftMs",
+                          stats.requests > 0 ? stats.total.ttftMs / stats.requests : 0.0);
+        setNumberProperty(env, result, "kvUsed", static_cast<double>(stats.kvUsed));
+        setNumberProperty(env, result, "kvSize", static_cast<double>(stats.kvSize));
+        setNumberProperty(env, result, "kvBytes", static_cast<double>(stats.kvBytes));
+        setNumberProperty(env, result, "kvOccupancy",
+                          stats.kvSize > 0 ? static_cast<double>(stats.kvUsed) / stats.kvSize : 0.0);
+        return result;
+    }
+
+    napi_value GetSpeculativeStats(napi_env env, napi_callback_info info) {
+        LlamaCppInterface::SpeculativeStats stats = getInstance()->getSpeculativeStats();
+        
+        napi_value result;
+        napi_create_object(env, &result);
+        setNumberProperty(env, result, "drafted", static_cast<double>(stats.drafted));
+        setNumberProperty(env, result, "accepted", static_cast<double>(stats.accepted));
+        setNumberProperty(env, result, "acceptanceRate",
+                          stats.drafted > 0 ? static_cast<double>(stats.accepted) / stats.drafted : 0.0);
+        return result;
+    }
+
+    napi_value GetPrefillProgress(napi_env env, napi_callback_info info) {
+        // Polled while an async request holds g_llamaMutex, so only touch the interface's atomics
+        size_t processed = 0;
+        size_t total = 0;
+        getInstance()->getPrefillProgress(processed, total);
+        
+        napi_value result;
+        napi_create_object(env, &result);
+        setNumberProperty(env, result, "processed", static_cast<double>(processed));
+        setNumberProperty(env, result, "total", static_cast<double>(total));
+        return result;
+    }
+
     napi_value ClearChatHistory(napi_env env, napi_callback_info info) {
+        AbortActiveRequest();
+        std::lock_guard<std::mutex> lock(g_llamaMutex);
         getInstance()->clearChatHistory();
         return nullptr;
     }
 
     napi_value GetModelInfo(napi_env env, napi_callback_info info) {
+        // Answered from the interface's snapshot, so it does not wait for a running request
         std::string modelInfo = getInstance()->getModelInfo();
         napi_value result;
         napi_create_string_utf8(env, modelInfo.c_str(), modelInfo.length(), &result);
@@ -151,6 +1637,7 @@ namespace LlamaCppNapi {
     }
 
     napi_value GetLastError(napi_env env, napi_callback_info info) {
+        // getLastError() has its own lock; waiting for g_llamaMutex would block on a running request
         std::string error = getInstance()->getLastError();
         napi_value result;
         napi_create_string_utf8(env, error.c_str(), error.length(), &result);
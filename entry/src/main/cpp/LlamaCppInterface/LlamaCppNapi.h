@@ -9,12 +9,55 @@ namespace LlamaCppNapi {
     napi_value UnloadModel(napi_env env, napi_callback_info info);
     napi_value IsModelLoaded(napi_env env, napi_callback_info info);
     
+    // Promise-based variants, executed off the JS thread
+    napi_value LoadModelAsync(napi_env env, napi_callback_info info);
+    napi_value LoadModelFromFd(napi_env env, napi_callback_info info);
+    napi_value CancelLoad(napi_env env, napi_callback_info info);
+    napi_value HandleMemoryPressure(napi_env env, napi_callback_info info);
+    napi_value GenerateTextAsync(napi_env env, napi_callback_info info);
+    napi_value ChatCompletionAsync(napi_env env, napi_callback_info info);
+    napi_value GenerateBatch(napi_env env, napi_callback_info info);
+    napi_value Cancel(napi_env env, napi_callback_info info);
+    napi_value GetPrefillProgress(napi_env env, napi_callback_info info);
+    
+    // Sessions: concurrent conversations batched over one context
+    napi_value CreateSession(napi_env env, napi_callback_info info);
+    napi_value DestroySession(napi_env env, napi_callback_info info);
+    napi_value SessionGenerate(napi_env env, napi_callback_info info);
+    
     // Text generation and chat
     napi_value GenerateText(napi_env env, napi_callback_info info);
     napi_value ChatCompletion(napi_env env, napi_callback_info info);
+    napi_value GenerateTextStream(napi_env env, napi_callback_info info);
+    napi_value ChatCompletionStream(napi_env env, napi_callback_info info);
     napi_value ClearChatHistory(napi_env env, napi_callback_info info);
+    napi_value SetSamplerConfig(napi_env env, napi_callback_info info);
+    
+    // Embeddings
+    napi_value Embed(napi_env env, napi_callback_info info);
+    
+    // Model pool
+    napi_value EnableModelPool(napi_env env, napi_callback_info info);
+    napi_value PreloadModel(napi_env env, napi_callback_info info);
+    napi_value GetModelPoolStats(napi_env env, napi_callback_info info);
+    
+    // Prefix cache
+    napi_value EnablePrefixCache(napi_env env, napi_callback_info info);
+    napi_value GetPrefixCacheStats(napi_env env, napi_callback_info info);
+    
+    // LoRA adapters
+    napi_value LoadLoraAdapter(napi_env env, napi_callback_info info);
+    napi_value SetLoraAdapter(napi_env env, napi_callback_info info);
+    napi_value RemoveLoraAdapter(napi_env env, napi_callback_info info);
+    napi_value ClearLoraAdapters(napi_env env, napi_callback_info info);
+    napi_value UnloadLoraAdapter(napi_env env, napi_callback_info info);
+    napi_value GetLoraAdapters(napi_env env, napi_callback_info info);
+    
+    // Speculative decoding
+    napi_value GetSpeculativeStats(napi_env env, napi_callback_info info);
     
     // Info and status
+    napi_value GetPerfStats(napi_env env, napi_callback_info info);
     napi_value GetModelInfo(napi_env env, napi_callback_info info);
     napi_value GetLastError(napi_env env, napi_callback_info info);
 }
@@ -0,0 +1,113 @@
+#include "ModelPool.h"
+#include <sys/stat.h>
+
+ModelPool::ModelPool(size_t maxBytes) : maxBytes_(maxBytes), totalBytes_(0), useCounter_(0) {}
+
+ModelPool::~ModelPool() {
+    for (Entry& entry : entries_) {
+        llama_model_free(entry.model);
+    }
+}
+
+llama_model* ModelPool::acquire(const std::string& path, const llama_model_params& params) {
+    const std::string key = makeKey(path, params);
+    for (Entry& entry : entries_) {
+        if (entry.key == key) {
+            entry.refs++;
+            entry.lastUse = ++useCounter_;
+            stats_.hits++;
+            return entry.model;
+        }
+    }
+    stats_.misses++;
+
+    // The file size is a close estimate of the loaded size; make room before loading
+    struct stat st;
+    evictToFit(stat(path.c_str(), &st) == 0 ? static_cast<size_t>(st.st_size) : 0);
+
+    llama_model* model = llama_model_load_from_file(path.c_str(), params);
+    if (!model) {
+        return nullptr;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.model = model;
+    entry.bytes = llama_model_size(model);
+    entry.refs = 1;
+    entry.lastUse = ++useCounter_;
+    totalBytes_ += entry.bytes;
+    entries_.push_back(entry);
+    evictToFit(0);
+    return model;
+}
+
+bool ModelPool::release(llama_model* model) {
+    for (Entry& entry : entries_) {
+        if (entry.model == model) {
+            if (entry.refs > 0) {
+                entry.refs--;
+            }
+            evictToFit(0);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ModelPool::setMaxBytes(size_t maxBytes) {
+    maxBytes_ = maxBytes;
+    evictToFit(0);
+}
+
+void ModelPool::evictIdle() {
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->refs > 0) {
+            ++it;
+            continue;
+        }
+        llama_model_free(it->model);
+        totalBytes_ -= it->bytes;
+        it = entries_.erase(it);
+        stats_.evictions++;
+    }
+}
+
+ModelPool::Stats ModelPool::getStats() const {
+    Stats stats = stats_;
+    stats.models = entries_.size();
+    stats.bytes = totalBytes_;
+    return stats;
+}
+
+std::string ModelPool::makeKey(const std::string& path, const llama_model_params& params) {
+    // The file identity keeps a replaced file, or a reused /proc/self/fd/N, from hitting a stale model
+    std::string key = path;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        key += "|" + std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino) + ":" +
+               std::to_string(st.st_size) + ":" + std::to_string(st.st_mtime);
+    }
+    // Models loaded with different memory strategies are different residents
+    return key + (params.use_mmap ? "|mmap" : "") + (params.use_mlock ? "|mlock" : "") +
+           (params.check_tensors ? "|checked" : "");
+}
+
+void ModelPool::evictToFit(size_t incomingBytes) {
+    while (totalBytes_ + incomingBytes > maxBytes_) {
+        // Least recently used model that nobody holds
+        auto victim = entries_.end();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->refs == 0 && (victim == entries_.end() || it->lastUse < victim->lastUse)) {
+                victim = it;
+            }
+        }
+        if (victim == entries_.end()) {
+            return;
+        }
+        llama_model_free(victim->model);
+        totalBytes_ -= victim->bytes;
+        entries_.erase(victim);
+        stats_.evictions++;
+    }
+}
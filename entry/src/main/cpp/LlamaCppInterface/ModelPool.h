@@ -0,0 +1,59 @@
+#ifndef MODEL_POOL_H
+#define MODEL_POOL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llama.h"
+
+// Keeps loaded models resident after they are released so switching back to one skips the load.
+// Models in use are pinned; released ones are freed least-recently-used first once the resident
+// total exceeds maxBytes. Not thread-safe: the owner serializes access.
+class ModelPool {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t models = 0;
+        size_t bytes = 0;
+    };
+
+    explicit ModelPool(size_t maxBytes);
+    ~ModelPool();
+
+    ModelPool(const ModelPool&) = delete;
+    ModelPool& operator=(const ModelPool&) = delete;
+
+    // Returns the resident model for path and load options, loading it on a miss; nullptr on failure.
+    // The model stays pinned until every acquire is matched by a release.
+    llama_model* acquire(const std::string& path, const llama_model_params& params);
+    // Returns false if model was not acquired from this pool
+    bool release(llama_model* model);
+
+    void setMaxBytes(size_t maxBytes);
+    // Frees every model nobody holds, regardless of the budget
+    void evictIdle();
+    Stats getStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        llama_model* model = nullptr;
+        size_t bytes = 0;
+        int refs = 0;
+        uint64_t lastUse = 0;
+    };
+
+    size_t maxBytes_;
+    size_t totalBytes_;
+    uint64_t useCounter_;
+    std::vector<Entry> entries_;
+    Stats stats_;
+
+    static std::string makeKey(const std::string& path, const llama_model_params& params);
+    void evictToFit(size_t incomingBytes);
+};
+
+#endif // MODEL_POOL_H
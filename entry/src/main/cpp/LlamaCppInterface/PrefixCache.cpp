@@ -0,0 +1,155 @@
+#include "PrefixCache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace {
+
+const char* const kEntrySuffix = ".kvstate";
+
+uint64_t fnv1a(const void* data, size_t len, uint64_t hash) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+PrefixCache::PrefixCache(const std::string& directory, size_t maxBytes)
+    : directory_(directory), maxBytes_(maxBytes), totalBytes_(0) {
+    mkdir(directory_.c_str(), 0700);
+    scanDirectory();
+    evictToFit();
+}
+
+bool PrefixCache::load(llama_context* ctx, llama_seq_id seqId, const std::vector<llama_token>& prefix,
+                       const std::string& modelId) {
+    const std::string key = makeKey(prefix, modelId);
+    if (entries_.count(key) == 0) {
+        stats_.misses++;
+        return false;
+    }
+
+    // The file stores the prefix tokens too; compare them to rule out hash collisions
+    std::vector<llama_token> tokens(prefix.size());
+    size_t nTokens = 0;
+    size_t nRead = llama_state_seq_load_file(ctx, pathFor(key).c_str(), seqId, tokens.data(), tokens.size(),
+                                             &nTokens);
+    if (nRead == 0 || nTokens != prefix.size() || !std::equal(prefix.begin(), prefix.end(), tokens.begin())) {
+        llama_memory_seq_rm(llama_get_memory(ctx), seqId, -1, -1);
+        removeEntry(key);
+        stats_.misses++;
+        return false;
+    }
+
+    touch(key);
+    stats_.hits++;
+    return true;
+}
+
+bool PrefixCache::save(llama_context* ctx, llama_seq_id seqId, const std::vector<llama_token>& prefix,
+                       const std::string& modelId) {
+    const std::string key = makeKey(prefix, modelId);
+    if (entries_.count(key) > 0) {
+        touch(key);
+        return true;
+    }
+
+    size_t nWritten = llama_state_seq_save_file(ctx, pathFor(key).c_str(), seqId, prefix.data(), prefix.size());
+    if (nWritten == 0) {
+        std::remove(pathFor(key).c_str());
+        return false;
+    }
+
+    Entry entry;
+    entry.bytes = nWritten;
+    entry.lastUse = nowNs();
+    entries_[key] = entry;
+    totalBytes_ += nWritten;
+    stats_.saves++;
+    evictToFit();
+    return true;
+}
+
+PrefixCache::Stats PrefixCache::getStats() const {
+    Stats stats = stats_;
+    stats.entries = entries_.size();
+    stats.bytes = totalBytes_;
+    return stats;
+}
+
+std::string PrefixCache::makeKey(const std::vector<llama_token>& prefix, const std::string& modelId) {
+    uint64_t hash = 14695981039346656037ULL;
+    hash = fnv1a(modelId.data(), modelId.size(), hash);
+    hash = fnv1a(prefix.data(), prefix.size() * sizeof(llama_token), hash);
+
+    char key[32];
+    snprintf(key, sizeof(key), "%016llx-%zu", static_cast<unsigned long long>(hash), prefix.size());
+    return key;
+}
+
+std::string PrefixCache::pathFor(const std::string& key) const {
+    return directory_ + "/" + key + kEntrySuffix;
+}
+
+void PrefixCache::scanDirectory() {
+    DIR* dir = opendir(directory_.c_str());
+    if (!dir) {
+        return;
+    }
+
+    const std::string suffix = kEntrySuffix;
+    while (dirent* item = readdir(dir)) {
+        std::string name = item->d_name;
+        if (name.size() <= suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        struct stat st;
+        if (stat((directory_ + "/" + name).c_str(), &st) != 0) {
+            continue;
+        }
+        Entry entry;
+        entry.bytes = static_cast<size_t>(st.st_size);
+        entry.lastUse = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        entries_[name.substr(0, name.size() - suffix.size())] = entry;
+        totalBytes_ += entry.bytes;
+    }
+    closedir(dir);
+}
+
+void PrefixCache::touch(const std::string& key) {
+    // Persist recency in the file mtime so LRU order survives a restart
+    entries_[key].lastUse = nowNs();
+    utimensat(AT_FDCWD, pathFor(key).c_str(), nullptr, 0);
+}
+
+void PrefixCache::evictToFit() {
+    while (totalBytes_ > maxBytes_ && !entries_.empty()) {
+        auto oldest = std::min_element(entries_.begin(), entries_.end(), [](const auto& a, const auto& b) {
+            return a.second.lastUse < b.second.lastUse;
+        });
+        removeEntry(oldest->first);
+        stats_.evictions++;
+    }
+}
+
+void PrefixCache::removeEntry(const std::string& key) {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return;
+    }
+    std::remove(pathFor(key).c_str());
+    totalBytes_ -= it->second.bytes;
+    entries_.erase(it);
+}
@@ -0,0 +1,56 @@
+#ifndef PREFIX_CACHE_H
+#define PREFIX_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "llama.h"
+
+// Content-addressed store of KV sequence state for token prefixes (typically system prompts).
+// Entries are keyed by a hash of the model identity and the prefix tokens, written with
+// llama_state_seq_save_file and evicted least-recently-used first once the directory exceeds maxBytes.
+class PrefixCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t saves = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    PrefixCache(const std::string& directory, size_t maxBytes);
+
+    // Restores the state for prefix into seqId; returns false on a miss or if the entry is unusable
+    bool load(llama_context* ctx, llama_seq_id seqId, const std::vector<llama_token>& prefix,
+              const std::string& modelId);
+    // Saves seqId, which must hold exactly prefix, and trims the cache back under its size bound
+    bool save(llama_context* ctx, llama_seq_id seqId, const std::vector<llama_token>& prefix,
+              const std::string& modelId);
+
+    Stats getStats() const;
+
+private:
+    struct Entry {
+        size_t bytes = 0;
+        int64_t lastUse = 0;  // file mtime in nanoseconds, refreshed on every hit
+    };
+
+    std::string directory_;
+    size_t maxBytes_;
+    size_t totalBytes_;
+    std::unordered_map<std::string, Entry> entries_;
+    Stats stats_;
+
+    static std::string makeKey(const std::vector<llama_token>& prefix, const std::string& modelId);
+    std::string pathFor(const std::string& key) const;
+    void scanDirectory();
+    void touch(const std::string& key);
+    void evictToFit();
+    void removeEntry(const std::string& key);
+};
+
+#endif // PREFIX_CACHE_H
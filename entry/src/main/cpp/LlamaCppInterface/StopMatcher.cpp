@@ -0,0 +1,112 @@
+#include "StopMatcher.h"
+#include <algorithm>
+#include <queue>
+
+StopMatcher::StopMatcher() : patternCount_(0), state_(0), matched_(false) {
+    states_.emplace_back();
+    states_[0].next.fill(-1);
+}
+
+void StopMatcher::setStops(const std::vector<std::string>& strings, const std::vector<llama_token>& tokens) {
+    tokens_ = tokens;
+    patternCount_ = 0;
+    states_.assign(1, State());
+    states_[0].next.fill(-1);
+
+    // Trie of the stop strings
+    for (const std::string& pattern : strings) {
+        if (pattern.empty()) {
+            continue;
+        }
+        int node = 0;
+        for (unsigned char c : pattern) {
+            if (states_[node].next[c] < 0) {
+                State state;
+                state.next.fill(-1);
+                state.depth = states_[node].depth + 1;
+                states_[node].next[c] = static_cast<int>(states_.size());
+                states_.push_back(state);
+            }
+            node = states_[node].next[c];
+        }
+        states_[node].matchLength = states_[node].depth;
+        ++patternCount_;
+    }
+
+    // Breadth-first: fill failure links and turn the trie into a full transition table
+    std::queue<int> queue;
+    for (int c = 0; c < 256; ++c) {
+        int child = states_[0].next[c];
+        if (child < 0) {
+            states_[0].next[c] = 0;
+        } else {
+            states_[child].fail = 0;
+            queue.push(child);
+        }
+    }
+    while (!queue.empty()) {
+        const int node = queue.front();
+        queue.pop();
+        State& state = states_[node];
+        if (state.matchLength == 0) {
+            state.matchLength = states_[state.fail].matchLength;
+        }
+        for (int c = 0; c < 256; ++c) {
+            const int child = state.next[c];
+            if (child < 0) {
+                state.next[c] = states_[state.fail].next[c];
+            } else {
+                states_[child].fail = states_[state.fail].next[c];
+                queue.push(child);
+            }
+        }
+    }
+
+    state_ = 0;
+    matched_ = false;
+    pending_.clear();
+    text_.clear();
+}
+
+bool StopMatcher::isStopToken(llama_token token) const {
+    return std::find(tokens_.begin(), tokens_.end(), token) != tokens_.end();
+}
+
+const std::string& StopMatcher::push(const std::string& piece) {
+    text_.clear();
+    if (matched_) {
+        return text_;
+    }
+    if (patternCount_ == 0) {
+        text_ = piece;
+        return text_;
+    }
+
+    for (unsigned char c : piece) {
+        pending_ += static_cast<char>(c);
+        state_ = states_[state_].next[c];
+        const int matchLength = states_[state_].matchLength;
+        if (matchLength > 0) {
+            // Release what precedes the stop string and drop the stop string itself
+            text_.append(pending_, 0, pending_.size() - matchLength);
+            pending_.clear();
+            matched_ = true;
+            return text_;
+        }
+    }
+
+    // Only the longest suffix that is still a stop string prefix has to wait for more text
+    const size_t release = pending_.size() - states_[state_].depth;
+    text_.append(pending_, 0, release);
+    pending_.erase(0, release);
+    return text_;
+}
+
+const std::string& StopMatcher::finish(const std::string& tail) {
+    push(tail);
+    if (!matched_) {
+        text_ += pending_;
+        pending_.clear();
+    }
+    return text_;
+}
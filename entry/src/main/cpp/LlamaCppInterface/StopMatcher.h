@@ -0,0 +1,46 @@
+#ifndef STOP_MATCHER_H
+#define STOP_MATCHER_H
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "llama.h"
+
+// Finds stop sequences in generated text as it streams, with an Aho-Corasick automaton over bytes, so
+// a stop string that spans several tokens is caught on the byte that completes it. Text that could
+// still turn into a stop string is held back (never more than the longest stop string) and released
+// once it cannot; text from the start of a matched stop string on is never released.
+class StopMatcher {
+public:
+    StopMatcher();
+
+    // Builds the automaton and starts a new stream
+    void setStops(const std::vector<std::string>& strings, const std::vector<llama_token>& tokens);
+    bool empty() const { return patternCount_ == 0 && tokens_.empty(); }
+
+    bool isStopToken(llama_token token) const;
+    // Returns the text of piece that is safe to hand out; valid until the next call
+    const std::string& push(const std::string& piece);
+    // Ends the stream: pushes tail and releases everything still held back unless a stop string matched
+    const std::string& finish(const std::string& tail);
+    bool matched() const { return matched_; }
+
+private:
+    struct State {
+        std::array<int, 256> next;
+        int fail = 0;
+        int depth = 0;
+        int matchLength = 0;  // longest stop string ending here, 0 if none
+    };
+
+    std::vector<State> states_;
+    std::vector<llama_token> tokens_;
+    size_t patternCount_;
+    int state_;
+    bool matched_;
+    std::string pending_;  // the last states_[state_].depth bytes seen
+    std::string text_;
+};
+
+#endif // STOP_MATCHER_H
@@ -0,0 +1,72 @@
+#include "StreamSink.h"
+#include <memory>
+
+StreamSink::StreamSink(Deliver deliver, size_t maxInFlight)
+    : deliver_(std::move(deliver)), maxInFlight_(maxInFlight > 0 ? maxInFlight : 1), stopRequested_(false),
+      inFlight_(0), failed_(false), finished_(false) {}
+
+bool StreamSink::deliverLocked(Chunk* chunk) {
+    std::unique_ptr<Chunk> owned(chunk);
+    ++inFlight_;
+    if (!deliver_(owned.get())) {
+        --inFlight_;
+        failed_ = true;
+        return false;
+    }
+    owned.release();
+    return true;
+}
+
+bool StreamSink::push(const std::string& piece) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_ || finished_) {
+        return false;
+    }
+    held_ += piece;
+    if (!held_.empty() && inFlight_ < maxInFlight_) {
+        auto chunk = new Chunk();
+        chunk->piece.swap(held_);
+        if (!deliverLocked(chunk)) {
+            return false;
+        }
+    }
+    return !stopRequested_;
+}
+
+void StreamSink::finish(const std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+    if (failed_) {
+        return;
+    }
+    // Held text goes out with the final chunk, so the consumer's queue bound does not delay the end
+    auto chunk = new Chunk();
+    chunk->piece.swap(held_);
+    chunk->done = true;
+    chunk->error = error;
+    deliverLocked(chunk);
+}
+
+void StreamSink::consumed(bool keepGoing) {
+    if (!keepGoing) {
+        stopRequested_ = true;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (inFlight_ > 0) {
+        --inFlight_;
+    }
+    // Text held back while the consumer was behind goes out now instead of waiting for the next piece
+    if (!held_.empty() && !finished_ && !failed_) {
+        auto chunk = new Chunk();
+        chunk->piece.swap(held_);
+        deliverLocked(chunk);
+    }
+}
+
+bool StreamSink::finished() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finished_;
+}
@@ -0,0 +1,51 @@
+#ifndef STREAM_SINK_H
+#define STREAM_SINK_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Hands streamed text from the generation thread to a consumer on another thread (the JS thread, through a
+// threadsafe function). At most maxInFlight chunks wait for the consumer; once that many are queued, new
+// pieces are appended to the next chunk instead, so a slow consumer gets fewer, larger chunks and the
+// generation thread never blocks on it. The final chunk is delivered exactly once, after all text.
+class StreamSink {
+public:
+    struct Chunk {
+        std::string piece;
+        bool done = false;
+        std::string error;  // set on the final chunk when generation failed
+    };
+
+    // Queues a chunk for the consumer and takes ownership of it; returns false if it could not be queued
+    using Deliver = std::function<bool(Chunk*)>;
+
+    StreamSink(Deliver deliver, size_t maxInFlight);
+
+    // Generation side. push() returns false once the consumer asked to stop or delivery failed, which ends
+    // generation; finish() flushes held text and delivers the final chunk.
+    bool push(const std::string& piece);
+    void finish(const std::string& error = "");
+
+    // Consumer side: called for every delivered chunk once it has been handled
+    void consumed(bool keepGoing);
+
+    void requestStop() { stopRequested_ = true; }
+    bool stopRequested() const { return stopRequested_; }
+    bool finished() const;
+
+private:
+    bool deliverLocked(Chunk* chunk);
+
+    Deliver deliver_;
+    size_t maxInFlight_;
+    std::atomic<bool> stopRequested_;
+    mutable std::mutex mutex_;
+    size_t inFlight_;
+    std::string held_;
+    bool failed_;
+    bool finished_;
+};
+
+#endif // STREAM_SINK_H
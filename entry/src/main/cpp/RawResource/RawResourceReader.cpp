@@ -0,0 +1,89 @@
+#include "RawResourceReader.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+RawResourceReader::RawResourceReader() : data_(""), size_(0), mapBase_(nullptr), mapLength_(0) {}
+
+RawResourceReader::~RawResourceReader() {
+    close();
+}
+
+bool RawResourceReader::openRange(int fd, int64_t offset, int64_t length, bool allowMap) {
+    close();
+    if (fd < 0 || offset < 0 || length < 0) {
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    if (allowMap) {
+        // mmap offsets must be page aligned; map from the page holding the first byte
+        const int64_t page = sysconf(_SC_PAGESIZE);
+        const int64_t aligned = offset - offset % page;
+        const size_t mapLength = static_cast<size_t>(length + (offset - aligned));
+        void* base = mmap(nullptr, mapLength, PROT_READ, MAP_PRIVATE, fd, aligned);
+        if (base != MAP_FAILED) {
+            madvise(base, mapLength, MADV_SEQUENTIAL);
+            mapBase_ = base;
+            mapLength_ = mapLength;
+            data_ = static_cast<const char*>(base) + (offset - aligned);
+            size_ = static_cast<size_t>(length);
+            return true;
+        }
+    }
+
+    // Read straight into the result, ending every chunk on a kChunkBytes boundary of the source
+    char* buffer = allocate(static_cast<size_t>(length));
+    size_t done = 0;
+    while (done < static_cast<size_t>(length)) {
+        const int64_t position = offset + static_cast<int64_t>(done);
+        const size_t chunk = std::min(kChunkBytes - static_cast<size_t>(position % kChunkBytes),
+                                      static_cast<size_t>(length) - done);
+        const ssize_t n = pread(fd, buffer + done, chunk, position);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close();
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool RawResourceReader::openFile(const std::string& path, bool allowMap) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    const bool opened = fstat(fd, &st) == 0 && openRange(fd, 0, st.st_size, allowMap);
+    ::close(fd);
+    return opened;
+}
+
+void RawResourceReader::close() {
+    if (mapBase_) {
+        munmap(mapBase_, mapLength_);
+        mapBase_ = nullptr;
+        mapLength_ = 0;
+    }
+    buffer_.reset();
+    data_ = "";
+    size_ = 0;
+}
+
+char* RawResourceReader::allocate(size_t size) {
+    // Uninitialized: every byte is overwritten by the read
+    buffer_.reset(new char[size]);
+    data_ = buffer_.get();
+    size_ = size;
+    return buffer_.get();
+}
@@ -0,0 +1,47 @@
+#ifndef RAW_RESOURCE_READER_H
+#define RAW_RESOURCE_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct NativeResourceManager;
+
+// Read-only view of a whole file or rawfile resource. A resource that is a plain byte range of a file
+// (rawfiles stored uncompressed in the HAP, files on disk) is mmapped in place; anything else is read
+// into one buffer in large chunks aligned to the source offset. data() stays valid until close() or
+// the next open.
+class RawResourceReader {
+public:
+    RawResourceReader();
+    ~RawResourceReader();
+
+    RawResourceReader(const RawResourceReader&) = delete;
+    RawResourceReader& operator=(const RawResourceReader&) = delete;
+
+    // length bytes at offset of fd; the descriptor is only used during the call. allowMap false forces
+    // the chunked read path.
+    bool openRange(int fd, int64_t offset, int64_t length, bool allowMap = true);
+    bool openFile(const std::string& path, bool allowMap = true);
+    // A file under resources/rawfile of the application (OHOS builds only)
+    bool openRawFile(const NativeResourceManager* resMgr, const std::string& fileName, bool allowMap = true);
+    void close();
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool mapped() const { return mapBase_ != nullptr; }
+
+private:
+    static const size_t kChunkBytes = 1 << 20;
+
+    const char* data_;
+    size_t size_;
+    void* mapBase_;
+    size_t mapLength_;
+    std::unique_ptr<char[]> buffer_;
+
+    char* allocate(size_t size);
+};
+
+#endif // RAW_RESOURCE_READER_H
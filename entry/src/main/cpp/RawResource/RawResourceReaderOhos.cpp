@@ -0,0 +1,46 @@
+#include "RawResourceReader.h"
+#include <algorithm>
+
+#include "rawfile/raw_file_manager.h"
+
+bool RawResourceReader::openRawFile(const NativeResourceManager* resMgr, const std::string& fileName,
+                                    bool allowMap) {
+    close();
+    RawFile64* rawFile = OH_ResourceManager_OpenRawFile64(resMgr, fileName.c_str());
+    if (!rawFile) {
+        return false;
+    }
+
+    // Uncompressed rawfiles are a byte range of the installed HAP and can be mapped in place
+    bool opened = false;
+    RawFileDescriptor64 descriptor;
+    if (OH_ResourceManager_GetRawFileDescriptor64(rawFile, &descriptor)) {
+        opened = openRange(descriptor.fd, descriptor.start, descriptor.length, allowMap);
+        OH_ResourceManager_ReleaseRawFileDescriptor64(&descriptor);
+    }
+
+    // Compressed ones only decompress through the resource manager
+    if (!opened) {
+        const int64_t length = OH_ResourceManager_GetRawFileSize64(rawFile);
+        if (length > 0) {
+            char* buffer = allocate(static_cast<size_t>(length));
+            int64_t done = 0;
+            while (done < length) {
+                const int64_t n = OH_ResourceManager_ReadRawFile64(
+                    rawFile, buffer + done, std::min(static_cast<int64_t>(kChunkBytes), length - done));
+                if (n <= 0) {
+                    break;
+                }
+                done += n;
+            }
+            opened = done == length;
+            if (!opened) {
+                close();
+            }
+        } else {
+            opened = length == 0;
+        }
+    }
+    OH_ResourceManager_CloseRawFile64(rawFile);
+    return opened;
+}
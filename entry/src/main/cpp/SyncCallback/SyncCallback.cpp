@@ -14,12 +14,7 @@
  */
 
 #include "SyncCallback.h"
-#include <memory>
-
-/*
- * Read the length of the text.
- */
-size_t g_contextLen = 50000;
+#include "RawResource/RawResourceReader.h"
 
 napi_value SyncCallback::SyncCallbackRead(napi_env env, napi_callback_info info) {
     size_t argc = 3;
@@ -33,20 +28,12 @@ napi_value SyncCallback::SyncCallbackRead(napi_env env, napi_callback_info info)
 
     NativeResourceManager *mNativeResMgr = OH_ResourceManager_InitNativeResourceManager(env, args[1]);
 
-    RawFile *rawFile = OH_ResourceManager_OpenRawFile(mNativeResMgr, fileNameBuf);
-
-    std::unique_ptr<char[]> fileData = std::make_unique<char[]>(g_contextLen);
-
-    long offset = 0;
-    while (OH_ResourceManager_GetRawFileRemainingLength(rawFile) > 0) {
-        OH_ResourceManager_ReadRawFile(rawFile, fileData.get() + offset, 100);
-        offset += 100;
-    }
+    RawResourceReader reader;
+    reader.openRawFile(mNativeResMgr, fileNameBuf);
 
-    OH_ResourceManager_CloseRawFile(rawFile);
     OH_ResourceManager_ReleaseNativeResourceManager(mNativeResMgr);
     napi_value contents;
-    napi_create_string_utf8(env, fileData.get(), NAPI_AUTO_LENGTH, &contents);
+    napi_create_string_utf8(env, reader.data(), reader.size(), &contents);
 
     napi_value res = nullptr;
     napi_call_function(env, nullptr, args[2], 1, &contents, &res);
@@ -0,0 +1,34 @@
+#include "TestHarness.h"
+#include "LlamaCppInterface/CpuTopology.h"
+
+#include <vector>
+
+TEST("cpu-topology-big-little") {
+    TestHarness::TempDir sysfs;
+    sysfs.write("online", "0-3,6\n");
+    for (int cpu : {0, 1, 6}) {
+        sysfs.write("cpu" + std::to_string(cpu) + "/cpu_capacity", "434\n");
+    }
+    for (int cpu : {2, 3}) {
+        sysfs.write("cpu" + std::to_string(cpu) + "/cpu_capacity", "1024\n");
+    }
+    CpuTopology topology = CpuTopology::detect(sysfs.path());
+    CHECK(topology.cpus() == std::vector<int>({0, 1, 2, 3, 6}));
+    CHECK(topology.performanceCpus() == std::vector<int>({2, 3}));
+    CHECK(topology.heterogeneous());
+}
+
+TEST("cpu-topology-fallbacks") {
+    TestHarness::TempDir sysfs;
+    sysfs.write("online", "0-1\n");
+    sysfs.write("cpu0/cpufreq/cpuinfo_max_freq", "1800000\n");
+    sysfs.write("cpu1/cpufreq/cpuinfo_max_freq", "2400000\n");
+    CpuTopology topology = CpuTopology::detect(sysfs.path());
+    CHECK(topology.performanceCpus() == std::vector<int>({1}));
+
+    TestHarness::TempDir flat;
+    flat.write("online", "0-2\n");
+    CpuTopology homogeneous = CpuTopology::detect(flat.path());
+    CHECK(homogeneous.performanceCpus() == std::vector<int>({0, 1, 2}));
+    CHECK(!homogeneous.heterogeneous());
+}
@@ -0,0 +1,25 @@
+#include "TestHarness.h"
+#include "LlamaFakes.h"
+#include "LlamaCppInterface/Detokenizer.h"
+
+TEST("detokenizer-partial-utf8") {
+    // "é" is C3 A9 and "€" is E2 82 AC, each split across tokens
+    const llama_vocab* vocab =
+        LlamaFakes::makeVocab({"caf", "\xC3", "\xA9", "!", "\xE2\x82", "\xAC", "0123456789abcdef"});
+    Detokenizer detokenizer(4);
+    detokenizer.reset(vocab);
+    CHECK_EQ(detokenizer.push(0), "caf");
+    CHECK_EQ(detokenizer.push(1), "");
+    CHECK_EQ(detokenizer.push(2), "\xC3\xA9");
+    CHECK_EQ(detokenizer.push(4), "");
+    CHECK_EQ(detokenizer.push(5), "\xE2\x82\xAC");
+    // Pieces longer than the reserved buffer grow it
+    CHECK_EQ(detokenizer.push(6), "0123456789abcdef");
+    CHECK_EQ(detokenizer.push(1), "");
+    CHECK_EQ(detokenizer.flush(), "\xC3");
+    CHECK_EQ(detokenizer.flush(), "");
+
+    CHECK_EQ(Detokenizer::toText(vocab, {0, 1, 2, 3}), "caf\xC3\xA9!");
+    // A stream that ends mid-character still returns its bytes
+    CHECK_EQ(Detokenizer::toText(vocab, {3, 4}), "!\xE2\x82");
+}
@@ -0,0 +1,106 @@
+// Minimal stand-ins for the llama.cpp functions used by the host-testable modules, so llama-ohos-tests
+// runs without a model file. Tokens map to fixed byte strings, models are plain files whose size is the
+// model size, and sequence state files hold the prompt tokens followed by padding.
+
+#include "LlamaFakes.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sys/stat.h>
+
+struct llama_vocab {
+    std::vector<std::string> pieces;
+};
+
+struct llama_model {
+    std::string path;
+    uint64_t size = 0;
+};
+
+struct llama_context {};
+
+namespace LlamaFakes {
+
+std::vector<std::string> freedModels;
+size_t stateBytes = 1024;
+
+const llama_vocab* makeVocab(const std::vector<std::string>& pieces) {
+    static std::vector<std::unique_ptr<llama_vocab>> vocabs;
+    vocabs.push_back(std::make_unique<llama_vocab>());
+    vocabs.back()->pieces = pieces;
+    return vocabs.back().get();
+}
+
+llama_context* context() {
+    static llama_context ctx;
+    return &ctx;
+}
+
+} // namespace LlamaFakes
+
+int32_t llama_token_to_piece(const struct llama_vocab* vocab, llama_token token, char* buf, int32_t length,
+                             int32_t /*lstrip*/, bool /*special*/) {
+    const std::string& piece = vocab->pieces.at(static_cast<size_t>(token));
+    const int32_t size = static_cast<int32_t>(piece.size());
+    if (size > length) {
+        return -size;
+    }
+    memcpy(buf, piece.data(), piece.size());
+    return size;
+}
+
+struct llama_model* llama_model_load_from_file(const char* path_model, struct llama_model_params /*params*/) {
+    struct stat st;
+    if (stat(path_model, &st) != 0) {
+        return nullptr;
+    }
+    auto model = new llama_model();
+    model->path = path_model;
+    model->size = static_cast<uint64_t>(st.st_size);
+    return model;
+}
+
+void llama_model_free(struct llama_model* model) {
+    LlamaFakes::freedModels.push_back(model->path);
+    delete model;
+}
+
+uint64_t llama_model_size(const struct llama_model* model) {
+    return model->size;
+}
+
+llama_memory_t llama_get_memory(const struct llama_context* /*ctx*/) {
+    return nullptr;
+}
+
+bool llama_memory_seq_rm(llama_memory_t /*mem*/, llama_seq_id /*seq_id*/, llama_pos /*p0*/, llama_pos /*p1*/) {
+    return true;
+}
+
+size_t llama_state_seq_save_file(struct llama_context* /*ctx*/, const char* filepath, llama_seq_id /*seq_id*/,
+                                 const llama_token* tokens, size_t n_token_count) {
+    std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+    const uint64_t count = n_token_count;
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    file.write(reinterpret_cast<const char*>(tokens), static_cast<std::streamsize>(n_token_count * sizeof(llama_token)));
+    const size_t written = sizeof(count) + n_token_count * sizeof(llama_token);
+    if (LlamaFakes::stateBytes > written) {
+        file.write(std::string(LlamaFakes::stateBytes - written, '\0').data(),
+                   static_cast<std::streamsize>(LlamaFakes::stateBytes - written));
+    }
+    return file ? std::max(written, LlamaFakes::stateBytes) : 0;
+}
+
+size_t llama_state_seq_load_file(struct llama_context* /*ctx*/, const char* filepath, llama_seq_id /*dest_seq_id*/,
+                                 llama_token* tokens_out, size_t n_token_capacity, size_t* n_token_count_out) {
+    std::ifstream file(filepath, std::ios::binary);
+    uint64_t count = 0;
+    if (!file.read(reinterpret_cast<char*>(&count), sizeof(count)) || count > n_token_capacity) {
+        return 0;
+    }
+    file.read(reinterpret_cast<char*>(tokens_out), static_cast<std::streamsize>(count * sizeof(llama_token)));
+    *n_token_count_out = static_cast<size_t>(count);
+    return file ? LlamaFakes::stateBytes : 0;
+}
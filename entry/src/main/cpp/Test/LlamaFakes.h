@@ -0,0 +1,23 @@
+#ifndef LLAMA_FAKES_H
+#define LLAMA_FAKES_H
+
+#include <string>
+#include <vector>
+
+#include "llama.h"
+
+// Controls and observations of the fake llama.cpp functions in LlamaFakes.cpp
+namespace LlamaFakes {
+
+// Paths of the models passed to llama_model_free, in order
+extern std::vector<std::string> freedModels;
+// Size reported for every saved or loaded sequence state file
+extern size_t stateBytes;
+
+// A vocabulary in which token i detokenizes to pieces[i]; lives until the process exits
+const llama_vocab* makeVocab(const std::vector<std::string>& pieces);
+llama_context* context();
+
+} // namespace LlamaFakes
+
+#endif // LLAMA_FAKES_H
@@ -0,0 +1,41 @@
+#include "TestHarness.h"
+#include "LlamaFakes.h"
+#include "LlamaCppInterface/ModelPool.h"
+
+TEST("model-pool-lru") {
+    TestHarness::TempDir dir;
+    const std::string a = dir.write("a.gguf", std::string(100, 'a'));
+    const std::string b = dir.write("b.gguf", std::string(100, 'b'));
+    const std::string c = dir.write("c.gguf", std::string(100, 'c'));
+    const std::string d = dir.write("d.gguf", std::string(100, 'd'));
+    llama_model_params params{};
+    LlamaFakes::freedModels.clear();
+    {
+        ModelPool pool(250);
+        llama_model* modelA = pool.acquire(a, params);
+        llama_model* modelB = pool.acquire(b, params);
+        CHECK(modelA != nullptr && modelB != nullptr);
+        CHECK(pool.release(modelA));
+        CHECK(pool.release(modelB));
+
+        // Using a again makes b the least recently used
+        CHECK(pool.acquire(a, params) == modelA);
+        CHECK(pool.release(modelA));
+        CHECK_EQ(pool.getStats().hits, 1u);
+
+        llama_model* modelC = pool.acquire(c, params);
+        CHECK(LlamaFakes::freedModels == std::vector<std::string>({b}));
+
+        // c is pinned, so d can only push out a
+        CHECK(pool.acquire(d, params) != nullptr);
+        CHECK(LlamaFakes::freedModels == std::vector<std::string>({b, a}));
+        CHECK(pool.release(modelC));
+
+        ModelPool::Stats stats = pool.getStats();
+        CHECK_EQ(stats.evictions, 2u);
+        CHECK_EQ(stats.misses, 4u);
+        CHECK_EQ(stats.models, 2u);
+        CHECK_EQ(stats.bytes, 200u);
+    }
+    CHECK_EQ(LlamaFakes::freedModels.size(), 4u);
+}
@@ -0,0 +1,38 @@
+#include "TestHarness.h"
+#include "LlamaFakes.h"
+#include "LlamaCppInterface/PrefixCache.h"
+
+TEST("prefix-cache-lru") {
+    TestHarness::TempDir dir;
+    LlamaFakes::stateBytes = 1000;
+    llama_context* ctx = LlamaFakes::context();
+    const std::vector<llama_token> first = {1, 2, 3};
+    const std::vector<llama_token> second = {4, 5};
+    const std::vector<llama_token> third = {6};
+    {
+        PrefixCache cache(dir.path(), 2500);
+        CHECK(cache.save(ctx, 1, first, "model"));
+        CHECK(cache.save(ctx, 1, second, "model"));
+        CHECK(cache.load(ctx, 1, first, "model"));
+        // Over budget: second is the least recently used entry
+        CHECK(cache.save(ctx, 1, third, "model"));
+        CHECK(!cache.load(ctx, 1, second, "model"));
+        CHECK(cache.load(ctx, 1, first, "model"));
+        CHECK(cache.load(ctx, 1, third, "model"));
+        // Keys include the model identity
+        CHECK(!cache.load(ctx, 1, first, "other-model"));
+
+        PrefixCache::Stats stats = cache.getStats();
+        CHECK_EQ(stats.saves, 3u);
+        CHECK_EQ(stats.evictions, 1u);
+        CHECK_EQ(stats.hits, 3u);
+        CHECK_EQ(stats.misses, 2u);
+        CHECK_EQ(stats.entries, 2u);
+        CHECK_EQ(stats.bytes, 2000u);
+    }
+
+    // Entries and their recency survive a restart
+    PrefixCache reopened(dir.path(), 2500);
+    CHECK_EQ(reopened.getStats().entries, 2u);
+    CHECK(reopened.load(ctx, 1, first, "model"));
+}
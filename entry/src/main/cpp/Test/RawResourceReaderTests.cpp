@@ -0,0 +1,48 @@
+#include "TestHarness.h"
+#include "RawResource/RawResourceReader.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+TEST("raw-resource-chunked-vs-mapped") {
+    // Longer than several read chunks and not a multiple of the page size
+    const size_t size = 3 * (1 << 20) + 123;
+    std::string contents(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        contents[i] = static_cast<char>((i * 31 + 7) & 0xFF);
+    }
+    TestHarness::TempDir dir;
+    const std::string path = dir.write("resource.bin", contents);
+    const int fd = open(path.c_str(), O_RDONLY);
+    CHECK(fd >= 0);
+
+    struct Range {
+        int64_t offset;
+        int64_t length;
+    };
+    for (const Range& range : {Range{0, static_cast<int64_t>(size)}, Range{4097, (2 << 20) + 5},
+                               Range{1, 1}, Range{static_cast<int64_t>(size) - 10, 10}}) {
+        RawResourceReader mapped;
+        RawResourceReader chunked;
+        CHECK(mapped.openRange(fd, range.offset, range.length, true));
+        CHECK(chunked.openRange(fd, range.offset, range.length, false));
+        CHECK(mapped.mapped());
+        CHECK(!chunked.mapped());
+        CHECK_EQ(mapped.size(), static_cast<size_t>(range.length));
+        CHECK_EQ(chunked.size(), static_cast<size_t>(range.length));
+        const char* expected = contents.data() + range.offset;
+        CHECK(mapped.size() == static_cast<size_t>(range.length) &&
+              memcmp(mapped.data(), expected, mapped.size()) == 0);
+        CHECK(chunked.size() == static_cast<size_t>(range.length) &&
+              memcmp(chunked.data(), expected, chunked.size()) == 0);
+    }
+    close(fd);
+
+    RawResourceReader reader;
+    CHECK(reader.openFile(path, false));
+    CHECK(reader.size() == size && memcmp(reader.data(), contents.data(), size) == 0);
+    reader.close();
+    CHECK_EQ(reader.size(), 0u);
+    CHECK(!reader.openFile(dir.path() + "/missing.bin"));
+}
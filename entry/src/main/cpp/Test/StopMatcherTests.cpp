@@ -0,0 +1,34 @@
+#include "TestHarness.h"
+#include "LlamaCppInterface/StopMatcher.h"
+
+TEST("stop-split-across-tokens") {
+    StopMatcher matcher;
+    matcher.setStops({"</s>"}, {});
+    std::string out;
+    out += matcher.push("Hello <");
+    out += matcher.push("/");
+    CHECK(!matcher.matched());
+    out += matcher.push("s> world");
+    CHECK(matcher.matched());
+    out += matcher.finish("");
+    CHECK_EQ(out, "Hello ");
+}
+
+TEST("stop-prefix-released") {
+    StopMatcher matcher;
+    matcher.setStops({"abc", "\nUser:"}, {});
+    // "ab" could still become "abc", so it is held back until "d" rules that out
+    CHECK_EQ(matcher.push("xab"), "x");
+    CHECK_EQ(matcher.push("d\nUs"), "abd");
+    CHECK_EQ(matcher.finish("e"), "\nUse");
+    CHECK(!matcher.matched());
+}
+
+TEST("stop-tokens") {
+    StopMatcher matcher;
+    matcher.setStops({}, {7});
+    CHECK(!matcher.empty());
+    CHECK(matcher.isStopToken(7));
+    CHECK(!matcher.isStopToken(8));
+    CHECK_EQ(matcher.push("plain"), "plain");
+}
@@ -0,0 +1,93 @@
+#include "TestHarness.h"
+#include "LlamaCppInterface/StreamSink.h"
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Stands in for the threadsafe function: chunks queue here until the test hands them to the consumer
+struct FakeConsumer {
+    std::vector<std::unique_ptr<StreamSink::Chunk>> queue;
+    std::vector<StreamSink::Chunk> received;
+    bool accept = true;
+
+    StreamSink::Deliver deliver() {
+        return [this](StreamSink::Chunk* chunk) {
+            if (!accept) {
+                return false;
+            }
+            queue.emplace_back(chunk);
+            return true;
+        };
+    }
+
+    // Runs the JS side for every queued chunk, including ones queued while draining
+    void drain(StreamSink& sink, bool keepGoing = true) {
+        while (!queue.empty()) {
+            std::unique_ptr<StreamSink::Chunk> chunk = std::move(queue.front());
+            queue.erase(queue.begin());
+            received.push_back(*chunk);
+            sink.consumed(keepGoing);
+        }
+    }
+};
+
+} // namespace
+
+TEST("stream-sink-coalesces-when-behind") {
+    FakeConsumer consumer;
+    StreamSink sink(consumer.deliver(), 2);
+    CHECK(sink.push("a"));
+    CHECK(sink.push("b"));
+    // Two chunks are waiting, so further pieces are held and merged
+    CHECK(sink.push("c"));
+    CHECK(sink.push("d"));
+    CHECK_EQ(consumer.queue.size(), 2u);
+
+    // Consuming frees a slot, and the held text goes out as one chunk
+    consumer.drain(sink);
+    CHECK_EQ(consumer.received.size(), 3u);
+    CHECK_EQ(consumer.received[2].piece, "cd");
+
+    CHECK(sink.push("e"));
+    sink.finish();
+    consumer.drain(sink);
+    CHECK_EQ(consumer.received.size(), 5u);
+    CHECK(consumer.received.back().done);
+    CHECK(consumer.received.back().error.empty());
+}
+
+TEST("stream-sink-final-chunk-once") {
+    FakeConsumer consumer;
+    StreamSink sink(consumer.deliver(), 1);
+    CHECK(sink.push("x"));
+    CHECK(sink.push("y"));
+    // Held text rides on the final chunk, which is never held back and never sent twice
+    sink.finish("decode failed");
+    sink.finish();
+    CHECK(sink.finished());
+    CHECK(!sink.push("z"));
+    consumer.drain(sink);
+    CHECK_EQ(consumer.received.size(), 2u);
+    CHECK_EQ(consumer.received[1].piece, "y");
+    CHECK(consumer.received[1].done);
+    CHECK_EQ(consumer.received[1].error, "decode failed");
+}
+
+TEST("stream-sink-stop-and-failed-delivery") {
+    FakeConsumer consumer;
+    StreamSink sink(consumer.deliver(), 4);
+    CHECK(sink.push("a"));
+    // The consumer returning false stops generation at the next piece
+    consumer.drain(sink, false);
+    CHECK(sink.stopRequested());
+    CHECK(!sink.push("b"));
+
+    FakeConsumer closed;
+    closed.accept = false;
+    StreamSink closedSink(closed.deliver(), 4);
+    CHECK(!closedSink.push("a"));
+    closedSink.finish();
+    CHECK(closed.queue.empty());
+}
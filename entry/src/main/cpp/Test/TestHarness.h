@@ -0,0 +1,64 @@
+#ifndef TEST_HARNESS_H
+#define TEST_HARNESS_H
+
+// Checks and test registration shared by the llama-ohos-tests sources. Each *Tests.cpp registers its
+// cases with TEST(); TestMain.cpp runs them.
+
+#include <iostream>
+#include <string>
+
+namespace TestHarness {
+
+// Number of failed checks so far
+extern int failures;
+
+// Adds a named test case to the list run by TestMain.cpp; used through TEST()
+struct Registrar {
+    Registrar(const char* name, void (*run)());
+};
+
+// A fresh directory under TMPDIR, removed with everything in it when the test ends
+class TempDir {
+public:
+    TempDir();
+    ~TempDir();
+
+    const std::string& path() const { return path_; }
+
+    // Writes contents to name (which may include subdirectories) and returns the full path
+    std::string write(const std::string& name, const std::string& contents) const;
+
+private:
+    std::string path_;
+};
+
+} // namespace TestHarness
+
+#define TEST_CONCAT_INNER(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT_INNER(a, b)
+#define TEST_IMPL(name, function)                                                 \
+    static void function();                                                       \
+    static const TestHarness::Registrar TEST_CONCAT(function, Registrar)(name, function); \
+    static void function()
+
+// TEST("suite-case") { ... } defines and registers a test; the name is what ctest passes on the command line
+#define TEST(name) TEST_IMPL(name, TEST_CONCAT(testCase, __LINE__))
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            ++TestHarness::failures;                                                        \
+        }                                                                                   \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                     \
+    do {                                                                                               \
+        if (!((actual) == (expected))) {                                                               \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #actual ", " #expected ") failed: " \
+                      << (actual) << " != " << (expected) << "\n";                                     \
+            ++TestHarness::failures;                                                                   \
+        }                                                                                              \
+    } while (0)
+
+#endif // TEST_HARNESS_H
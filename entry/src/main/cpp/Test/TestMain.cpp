@@ -0,0 +1,78 @@
+// Runner for the host unit tests of the modules that build without the OHOS SDK. llama.cpp is replaced by
+// the fakes in LlamaFakes.cpp, so no model file is needed.
+//
+//   llama-ohos-tests [test-name]
+//
+// Runs every registered test, or only the named one; exits non-zero if any check fails.
+
+#include "TestHarness.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+#include <vector>
+
+namespace TestHarness {
+
+int failures = 0;
+
+namespace {
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+std::vector<TestCase>& registry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+} // namespace
+
+Registrar::Registrar(const char* name, void (*run)()) {
+    registry().push_back({name, run});
+}
+
+TempDir::TempDir() {
+    const char* base = getenv("TMPDIR");
+    std::string pattern = std::string(base ? base : "/tmp") + "/llama-ohos-tests-XXXXXX";
+    path_ = mkdtemp(&pattern[0]) ? pattern : "";
+}
+
+TempDir::~TempDir() {
+    if (!path_.empty()) {
+        std::string command = "rm -rf '" + path_ + "'";
+        (void)system(command.c_str());
+    }
+}
+
+std::string TempDir::write(const std::string& name, const std::string& contents) const {
+    const std::string file = path_ + "/" + name;
+    std::string dir = file.substr(0, file.rfind('/'));
+    std::string command = "mkdir -p '" + dir + "'";
+    (void)system(command.c_str());
+    std::ofstream(file, std::ios::binary) << contents;
+    return file;
+}
+
+} // namespace TestHarness
+
+int main(int argc, char** argv) {
+    const std::string only = argc > 1 ? argv[1] : "";
+    bool found = false;
+    for (const TestHarness::TestCase& test : TestHarness::registry()) {
+        if (!only.empty() && only != test.name) {
+            continue;
+        }
+        found = true;
+        const int before = TestHarness::failures;
+        test.run();
+        std::cout << (TestHarness::failures == before ? "PASS " : "FAIL ") << test.name << "\n";
+    }
+    if (!found) {
+        std::cerr << "Unknown test: " << only << "\n";
+        return 2;
+    }
+    return TestHarness::failures == 0 ? 0 : 1;
+}
@@ -45,7 +45,50 @@ static napi_value Init(napi_env env, napi_value exports) {
         {"isModelLoaded", nullptr, LlamaCppNapi::IsModelLoaded, nullptr, nullptr, nullptr, napi_default, nullptr},
         {"generateText", nullptr, LlamaCppNapi::GenerateText, nullptr, nullptr, nullptr, napi_default, nullptr},
         {"chatCompletion", nullptr, LlamaCppNapi::ChatCompletion, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"generateTextStream", nullptr, LlamaCppNapi::GenerateTextStream, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"chatCompletionStream", nullptr, LlamaCppNapi::ChatCompletionStream, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"loadModelAsync", nullptr, LlamaCppNapi::LoadModelAsync, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"loadModelFromFd", nullptr, LlamaCppNapi::LoadModelFromFd, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"cancelLoad", nullptr, LlamaCppNapi::CancelLoad, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"handleMemoryPressure", nullptr, LlamaCppNapi::HandleMemoryPressure, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"generateTextAsync", nullptr, LlamaCppNapi::GenerateTextAsync, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"chatCompletionAsync", nullptr, LlamaCppNapi::ChatCompletionAsync, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"generateBatch", nullptr, LlamaCppNapi::GenerateBatch, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"cancel", nullptr, LlamaCppNapi::Cancel, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"getPrefillProgress", nullptr, LlamaCppNapi::GetPrefillProgress, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"createSession", nullptr, LlamaCppNapi::CreateSession, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"destroySession", nullptr, LlamaCppNapi::DestroySession, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"sessionGenerate", nullptr, LlamaCppNapi::SessionGenerate, nullptr, nullptr, nullptr, napi_default, nullptr},
         {"clearChatHistory", nullptr, LlamaCppNapi::ClearChatHistory, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"setSamplerConfig", nullptr, LlamaCppNapi::SetSamplerConfig, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"embed", nullptr, LlamaCppNapi::Embed, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"enableModelPool", nullptr, LlamaCppNapi::EnableModelPool, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"preloadModel", nullptr, LlamaCppNapi::PreloadModel, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"getModelPoolStats", nullptr, LlamaCppNapi::GetModelPoolStats, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"enablePrefixCache", nullptr, LlamaCppNapi::EnablePrefixCache, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"getPrefixCacheStats", nullptr, LlamaCppNapi::GetPrefixCacheStats, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"loadLoraAdapter", nullptr, LlamaCppNapi::LoadLoraAdapter, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"setLoraAdapter", nullptr, LlamaCppNapi::SetLoraAdapter, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"removeLoraAdapter", nullptr, LlamaCppNapi::RemoveLoraAdapter, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"clearLoraAdapters", nullptr, LlamaCppNapi::ClearLoraAdapters, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"unloadLoraAdapter", nullptr, LlamaCppNapi::UnloadLoraAdapter, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"getLoraAdapters", nullptr, LlamaCppNapi::GetLoraAdapters, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"getSpeculativeStats", nullptr, LlamaCppNapi::GetSpeculativeStats, nullptr, nullptr, nullptr, napi_default,
+         nullptr},
+        {"getPerfStats", nullptr, LlamaCppNapi::GetPerfStats, nullptr, nullptr, nullptr, napi_default, nullptr},
         {"getModelInfo", nullptr, LlamaCppNapi::GetModelInfo, nullptr, nullptr, nullptr, napi_default, nullptr},
         {"getLastError", nullptr, LlamaCppNapi::GetLastError, nullptr, nullptr, nullptr, napi_default, nullptr},
     };
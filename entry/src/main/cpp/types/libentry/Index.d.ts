@@ -28,8 +28,53 @@ export const libUvCaseFun: (work: object) => void;
 export const destroy: () => void;
 
 // LlamaCpp functions
-export const loadModel: (modelPath: string, contextSize?: number, threads?: number) => boolean;
+// maxSessions reserves KV sequences for createSession(); every sequence (including the default chat)
+// is limited to contextSize / (maxSessions + 1) tokens. Prompts are prefilled batchSize tokens per decode
+// (default 512) and ubatchSize (default 512) sizes the compute buffers: lower values reduce peak memory.
+// draftModelPath enables speculative decoding with a smaller model sharing the target's vocabulary;
+// it proposes up to draftTokens (default 8) tokens that the target verifies in one decode.
+// useMmap (default true) maps the weights lazily, useMlock (default false) pins them in RAM and
+// checkTensors (default false) validates tensor data during the load.
+// prefillThreads and decodeThreads (default: threads) size the prompt and token-by-token threadpools. With
+// pinThreads (default true) both are pinned to the performance cores of big.LITTLE CPUs, or to all cores when
+// a pool has more threads than there are performance cores. pollLevel (0-100, default 50) is how long idle
+// workers spin before sleeping.
+// kvCacheTypeK/kvCacheTypeV quantize the KV cache; a quantized V cache needs flashAttention 'auto' or 'on'.
+// spillDirectory (e.g. the ability's cacheDir) receives the KV state of each conversation under memory
+// pressure; without it the state is dropped and rebuilt from the chat history.
+export interface LoadConfig {
+  contextSize?: number;
+  threads?: number;
+  maxSessions?: number;
+  batchSize?: number;
+  ubatchSize?: number;
+  draftModelPath?: string;
+  draftTokens?: number;
+  useMmap?: boolean;
+  useMlock?: boolean;
+  checkTensors?: boolean;
+  prefillThreads?: number;
+  decodeThreads?: number;
+  pinThreads?: boolean;
+  threadPriority?: 'low' | 'normal' | 'medium' | 'high' | 'realtime';
+  pollLevel?: number;
+  kvCacheTypeK?: 'f16' | 'q8_0' | 'q4_0';
+  kvCacheTypeV?: 'f16' | 'q8_0' | 'q4_0';
+  flashAttention?: 'auto' | 'on' | 'off';
+  offloadKv?: boolean;
+  defragThreshold?: number;
+  spillDirectory?: string;
+}
 
+export const loadModel: {
+  (modelPath: string, config: LoadConfig): boolean;
+  (modelPath: string, contextSize?: number, threads?: number, maxSessions?: number, batchSize?: number,
+    ubatchSize?: number): boolean;
+};
+
+// unloadModel and clearChatHistory cancel a running async request and any streams first instead of waiting
+// for them to finish; unloadModel also cancels loads that are running or still queued, and returns once the
+// cancelled streams' threads have exited
 export const unloadModel: () => void;
 
 export const isModelLoaded: () => boolean;
@@ -38,8 +83,213 @@ export const generateText: (prompt: string, maxTokens?: number, temperature?: nu
 
 export const chatCompletion: (userInput: string, systemPrompt?: string) => string;
 
+// Streaming variants: onToken receives each piece as it is sampled and a final call with done = true, which
+// carries error when generation failed. Pieces arriving faster than onToken returns are merged into fewer
+// calls. Returning false from onToken stops generation early.
+export const generateTextStream: (prompt: string, onToken: (piece: string, done: boolean, error?: string) => boolean | void,
+  maxTokens?: number, temperature?: number, topP?: number) => void;
+
+export const chatCompletionStream: (userInput: string, onToken: (piece: string, done: boolean, error?: string) => boolean | void,
+  systemPrompt?: string) => void;
+
+// Promise-based variants run off the UI thread. requestId is chosen by the caller and can be passed
+// to cancel() to stop a queued or running request; a cancelled request rejects with "Request cancelled".
+// With a config object, onProgress receives load progress in [0, 1]. cancelLoad() stops the running load and
+// any queued ones, which then resolve false (a load that had started with getLastError() === "Model load
+// cancelled"); it returns false if no load is pending and never affects a later load.
+export const loadModelAsync: {
+  (modelPath: string, config: LoadConfig, onProgress?: (progress: number) => void): Promise<boolean>;
+  (modelPath: string, contextSize?: number, threads?: number, maxSessions?: number, batchSize?: number,
+    ubatchSize?: number): Promise<boolean>;
+};
+
+// Loads the GGUF at [offset, offset + length) of an open file without copying it (length 0: to the end), e.g.
+// fs.openSync(path).fd at offset 0. Keep fd open until the promise settles; the model keeps its own reference.
+// llama.cpp maps a model from the start of its file, so the range must be the whole file: a non-zero offset or
+// a length other than 0 or the file size, such as a resourceManager.getRawFd() range inside the HAP, throws.
+export const loadModelFromFd: (fd: number, offset: number, length: number, config?: LoadConfig,
+  onProgress?: (progress: number) => void) => Promise<boolean>;
+
+export const cancelLoad: () => boolean;
+
+// Forward AbilityStage/UIAbility onMemoryLevel(level) here. Each level includes the ones before it:
+// 0 (moderate) frees the batch and embedding contexts and idle pooled models, 1 (low) spills the KV state
+// and frees the inference contexts, 2 (critical) also releases the model. Chat history and sessions are
+// kept; the next request restores what it needs. Resolves to the level actually applied (-1 for none):
+// running session requests keep the contexts alive.
+export const handleMemoryPressure: (level: number) => Promise<number>;
+
+// Time limits in milliseconds, omitted or 0 for none: prompt prefill, the whole request, and the wait for each
+// next token. With deadlines the promise resolves to a GenerationResult; a request past a deadline stops within
+// one batch, keeps the text generated so far and reports truncated = true.
+export interface Deadlines {
+  prefillMs?: number;
+  totalMs?: number;
+  tokenGapMs?: number;
+}
+
+export interface GenerationResult {
+  text: string;
+  finishReason: 'stop' | 'length' | 'prefill_deadline' | 'total_deadline' | 'token_deadline';
+  truncated: boolean;
+}
+
+export const generateTextAsync: {
+  (requestId: number, prompt: string, maxTokens?: number, temperature?: number, topP?: number): Promise<string>;
+  (requestId: number, prompt: string, maxTokens: number, temperature: number | undefined, topP: number | undefined,
+    deadlines: Deadlines): Promise<GenerationResult>;
+};
+
+export const chatCompletionAsync: {
+  (requestId: number, userInput: string, systemPrompt?: string): Promise<string>;
+  (requestId: number, userInput: string, systemPrompt: string, deadlines: Deadlines): Promise<GenerationResult>;
+};
+
+// Up to 16 completions in parallel: the common prompt prefix is prefilled once and shared, then all
+// sequences decode together. Each completion stops at end of generation, maxTokens (default 100) or the
+// first stop string, which is cut off. Uses the default sampler config with a distinct seed per sequence.
+export const generateBatch: (requestId: number, prompts: string[], maxTokens?: number,
+  stop?: string[]) => Promise<string[]>;
+
+export const cancel: (requestId: number) => boolean;
+
+export interface PrefillProgress {
+  processed: number;
+  total: number;
+}
+
+// Prompt tokens prefilled so far by the running request; safe to poll while an async request runs.
+export const getPrefillProgress: () => PrefillProgress;
+
+// Sessions are independent conversations. Concurrent sessionGenerate calls are decoded together in one batch.
+// createSession returns -1 when no slot is free or the model was loaded without maxSessions.
+export const createSession: (systemPrompt?: string) => number;
+
+export const destroySession: (sessionId: number) => boolean;
+
+export const sessionGenerate: (sessionId: number, userInput: string, maxTokens?: number) => Promise<string>;
+
 export const clearChatHistory: () => void;
 
+// Sampler chains are built once per conversation and reset between requests. Omitted fields take the
+// defaults shown; sessionId -1 (default) configures the next generateText/chatCompletion, whose temperature and
+// topP arguments update this config when passed and leave it alone when omitted. temperature <= 0 samples
+// greedily. Generation stops as soon as the output contains a stop string, even one split across tokens
+// (it is cut from the result and never streamed), or a stop token id is sampled. Chats with models lacking a chat template also stop at "\nUser:".
+export interface SamplerConfig {
+  temperature?: number;       // 0.8
+  topP?: number;              // 0.95
+  topK?: number;              // 0 = off
+  minP?: number;              // 0 = off
+  typicalP?: number;          // 1 = off
+  penaltyLastN?: number;      // 64, -1 = whole context
+  repeatPenalty?: number;     // 1 = off
+  frequencyPenalty?: number;  // 0 = off
+  presencePenalty?: number;   // 0 = off
+  seed?: number;              // random when omitted
+  stop?: string[];
+  stopTokens?: number[];
+}
+
+export const setSamplerConfig: (config: SamplerConfig, sessionId?: number) => boolean;
+
+// Sentence embeddings for all texts, computed in as few batches as possible. Resolves to one ArrayBuffer of
+// Float32 data holding texts.length L2-normalized vectors back to back; the vector size is
+// byteLength / 4 / texts.length. Texts longer than the context size are truncated.
+export const embed: (texts: string[], pooling?: 'mean' | 'cls' | 'last') => Promise<ArrayBuffer>;
+
+// Model pool: after enableModelPool, unloaded models stay resident until their total size exceeds
+// maxMegabytes and are then freed least-recently-used first. Loading a resident model again only creates a
+// new context. Await it before the first load; calling again changes the budget. preloadModel warms a model
+// without switching to it.
+export const enableModelPool: (maxMegabytes: number) => Promise<boolean>;
+
+export const preloadModel: (modelPath: string, config?: LoadConfig) => Promise<boolean>;
+
+export interface ModelPoolStats {
+  hits: number;
+  misses: number;
+  evictions: number;
+  models: number;
+  bytes: number;
+}
+
+export const getModelPoolStats: () => ModelPoolStats;
+
+// Prefix cache: KV state of long system prompts is saved under directory and restored on later runs.
+// Entries are evicted least-recently-used first once the directory exceeds maxMegabytes (default 256).
+export const enablePrefixCache: (directory: string, maxMegabytes?: number) => Promise<boolean>;
+
+export interface PrefixCacheStats {
+  hits: number;
+  misses: number;
+  saves: number;
+  evictions: number;
+  entries: number;
+  bytes: number;
+}
+
+export const getPrefixCacheStats: () => PrefixCacheStats;
+
+// LoRA adapters of the loaded model: loaded once, then attached (setLoraAdapter), re-scaled or detached
+// between requests without reloading the model. Changing the active set drops the KV cache and returns
+// false while session requests are running. Adapters are freed when the model is unloaded. Changes are applied
+// between requests, so await them before the request that should see them.
+export interface LoraAdapterInfo {
+  name: string;
+  path: string;
+  scale: number;  // 0 while detached
+}
+
+export const loadLoraAdapter: (name: string, path: string) => Promise<boolean>;
+export const setLoraAdapter: (name: string, scale?: number) => Promise<boolean>;
+export const removeLoraAdapter: (name: string) => Promise<boolean>;
+export const clearLoraAdapters: () => Promise<boolean>;
+export const unloadLoraAdapter: (name: string) => Promise<boolean>;
+export const getLoraAdapters: () => LoraAdapterInfo[];
+
+// Draft tokens proposed and accepted since the model was loaded; all zero without a draft model.
+export interface SpeculativeStats {
+  drafted: number;
+  accepted: number;
+  acceptanceRate: number;
+}
+
+export const getSpeculativeStats: () => SpeculativeStats;
+
+// Timings of generateText/chatCompletion calls. Wall-clock fields come from our own timers; *EvalMs and
+// samplingMs come from llama.cpp's perf counters. Tokens per second are derived from the wall-clock times.
+export interface RequestPerf {
+  promptTokens: number;
+  prefilledTokens: number;
+  generatedTokens: number;
+  prefillMs: number;
+  decodeMs: number;
+  ttftMs: number;
+  samplingMs: number;
+  sampledTokens: number;
+  samplingMsPerToken: number;
+  prefillEvalMs: number;
+  decodeEvalMs: number;
+  prefillTokensPerSecond: number;
+  decodeTokensPerSecond: number;
+}
+
+export interface PerfStats {
+  last: RequestPerf;
+  total: RequestPerf;
+  requests: number;
+  averageTtftMs: number;
+  kvUsed: number;
+  kvSize: number;
+  kvBytes: number;
+  kvOccupancy: number;
+}
+
+// Stats and model info are snapshots taken after every request and configuration change; reading them
+// never waits for a running request.
+export const getPerfStats: () => PerfStats;
+
 export const getModelInfo: () => string;
 
 export const getLastError: () => string;
\ No newline at end of file